@@ -136,8 +136,8 @@ kotlin {
         create("quickjs") {
           header(file("native/quickjs/quickjs.h"))
           header(file("native/common/context-no-eval.h"))
-          header(file("native/common/finalization-registry.h"))
           header(file("native/common/global-gc.h"))
+          header(file("native/common/timers.h"))
           packageName("app.cash.zipline.quickjs")
         }
       }
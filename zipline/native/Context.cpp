@@ -21,8 +21,8 @@
 #include "InboundCallChannel.h"
 #include "ExceptionThrowers.h"
 #include "common/context-no-eval.h"
-#include "common/finalization-registry.h"
 #include "common/global-gc.h"
+#include "common/timers.h"
 #include "quickjs/quickjs.h"
 
 /**
@@ -42,6 +42,25 @@ int jsInterruptHandlerPoll(JSRuntime* jsRuntime, void *opaque) {
   return halt;
 }
 
+/**
+ * This signature satisfies the JSGCCallback typedef. It is only installed while a Kotlin GcListener
+ * is configured.
+ */
+void jsGcCallback(JSRuntime* jsRuntime, void *opaque) {
+  auto context = reinterpret_cast<Context*>(opaque);
+  JS_SetGCCallback(context->jsRuntime, NULL, NULL); // Suppress re-enter.
+  auto env = context->getEnv();
+  jobject stats = context->gcStats(env);
+  env->CallVoidMethod(context->gcListener, context->gcListenerGcCompleted, stats);
+  if (env->ExceptionCheck()) {
+    // The collector may run inside any allocation, so there's no JS call to fail. Drop it.
+    env->ExceptionDescribe();
+    env->ExceptionClear();
+  }
+  env->DeleteLocalRef(stats);
+  JS_SetGCCallback(context->jsRuntime, &jsGcCallback, context); // Restore callback.
+}
+
 namespace {
 
 void jsFinalizeOutboundCallChannel(JSRuntime* jsRuntime, JSValue val) {
@@ -52,6 +71,46 @@ void jsFinalizeOutboundCallChannel(JSRuntime* jsRuntime, JSValue val) {
   }
 }
 
+/** The Java objects backing an ArrayBuffer created by setArrayBuffer(). */
+struct ExternalArrayBuffer {
+  jobject buffer;
+  jobject onRelease;
+};
+
+void jsFreeExternalArrayBuffer(JSRuntime* jsRuntime, void* opaque, void* ptr) {
+  auto context = reinterpret_cast<const Context*>(JS_GetRuntimeOpaque(jsRuntime));
+  auto externalArrayBuffer = reinterpret_cast<ExternalArrayBuffer*>(opaque);
+  auto env = context->getEnv();
+  if (externalArrayBuffer->onRelease != nullptr) {
+    auto runnableClass = env->GetObjectClass(externalArrayBuffer->onRelease);
+    env->CallVoidMethod(externalArrayBuffer->onRelease,
+                        env->GetMethodID(runnableClass, "run", "()V"));
+    env->DeleteLocalRef(runnableClass);
+    if (env->ExceptionCheck()) {
+      // The ArrayBuffer may be freed by the collector or by close(), so there's no call to fail.
+      env->ExceptionDescribe();
+      env->ExceptionClear();
+    }
+    env->DeleteGlobalRef(externalArrayBuffer->onRelease);
+  }
+  env->DeleteGlobalRef(externalArrayBuffer->buffer);
+  delete externalArrayBuffer;
+}
+
+/** This signature satisfies the ScheduleTimersFunc typedef. */
+int jsScheduleTimers(void* opaque, int32_t bucketId, int32_t delayMillis) {
+  auto context = reinterpret_cast<const Context*>(opaque);
+  if (context->timerScheduler == nullptr) return 0; // The context is being destroyed.
+  auto env = context->getEnv();
+  env->CallVoidMethod(context->timerScheduler, context->timerSchedulerScheduleTimers, bucketId,
+                      delayMillis);
+  if (env->ExceptionCheck()) {
+    context->throwJavaExceptionFromJs(env);
+    return -1;
+  }
+  return 0;
+}
+
 struct JniThreadDetacher {
   JavaVM& javaVm;
 
@@ -91,17 +150,20 @@ Context::Context(JNIEnv* env)
                                                    "(Ljava/lang/String;Ljava/lang/String;)V")),
       interruptHandlerClass(static_cast<jclass>(env->NewGlobalRef(env->FindClass("app/cash/zipline/InterruptHandler")))),
       interruptHandlerPoll(env->GetMethodID(interruptHandlerClass, "poll", "()Z")),
-      interruptHandler(nullptr) {
+      interruptHandler(nullptr),
+      gcStatsClass(static_cast<jclass>(env->NewGlobalRef(env->FindClass("app/cash/zipline/GcStats")))),
+      gcStatsConstructor(env->GetMethodID(gcStatsClass, "<init>", "(JJJJJJJJ)V")),
+      gcListenerClass(static_cast<jclass>(env->NewGlobalRef(env->FindClass("app/cash/zipline/GcListener")))),
+      gcListenerGcCompleted(env->GetMethodID(gcListenerClass, "gcCompleted", "(Lapp/cash/zipline/GcStats;)V")),
+      gcListener(nullptr),
+      timerScheduler(nullptr),
+      timerSchedulerScheduleTimers(nullptr),
+      timers(JS_UNDEFINED) {
   env->GetJavaVM(&javaVm);
   JS_SetRuntimeOpaque(jsRuntime, this);
   JS_SetInterruptHandler(jsRuntime, &jsInterruptHandlerPoll, this);
 
   JS_AddGlobalThisGc(jsContext);
-
-  if (installFinalizationRegistry(jsContext, jsContextForCompiling) < 0) {
-    throwJavaException(env, "java/lang/IllegalStateException",
-                       "Failed to install FinalizationRegistry");
-  }
 }
 
 Context::~Context() {
@@ -112,9 +174,23 @@ Context::~Context() {
   for (auto refs : globalReferences) {
     env->DeleteGlobalRef(refs.second);
   }
+  for (auto retained : retainedArrayBuffers) {
+    JS_FreeValue(jsContext, retained.second.first);
+  }
+  JS_FreeValue(jsContext, timers);
+  if (timerScheduler != nullptr) {
+    env->DeleteGlobalRef(timerScheduler);
+    timerScheduler = nullptr;
+  }
   if (interruptHandler != nullptr) {
     env->DeleteGlobalRef(interruptHandler);
   }
+  if (gcListener != nullptr) {
+    JS_SetGCCallback(jsRuntime, NULL, NULL);
+    env->DeleteGlobalRef(gcListener);
+  }
+  env->DeleteGlobalRef(gcListenerClass);
+  env->DeleteGlobalRef(gcStatsClass);
   env->DeleteGlobalRef(interruptHandlerClass);
   env->DeleteGlobalRef(quickJsExceptionClass);
   env->DeleteGlobalRef(stringUtf8);
@@ -131,6 +207,29 @@ Context::~Context() {
   JS_FreeRuntime(jsRuntime);
 }
 
+void Context::initTimers(JNIEnv* env, jobject newTimerScheduler) {
+  assert(timerScheduler == nullptr);
+  timerScheduler = env->NewGlobalRef(newTimerScheduler);
+  auto timerSchedulerClass = env->GetObjectClass(timerScheduler);
+  timerSchedulerScheduleTimers = env->GetMethodID(timerSchedulerClass, "scheduleTimers", "(II)V");
+  env->DeleteLocalRef(timerSchedulerClass);
+
+  timers = installTimers(jsContext, &jsScheduleTimers, this);
+  if (JS_IsException(timers)) {
+    throwJsException(env, timers);
+  }
+}
+
+void Context::startTimers(JNIEnv* env, jint bucketId) {
+  ::startTimers(jsContext, timers, bucketId);
+}
+
+void Context::runTimers(JNIEnv* env, jint bucketId) {
+  if (::runTimers(jsContext, timers, bucketId) < 0) {
+    throwJsException(env, JS_EXCEPTION);
+  }
+}
+
 jobject Context::execute(JNIEnv* env, jbyteArray byteCode) {
   const auto buffer = env->GetByteArrayElements(byteCode, nullptr);
   const auto bufferLength = env->GetArrayLength(byteCode);
@@ -161,6 +260,15 @@ jobject Context::execute(JNIEnv* env, jbyteArray byteCode) {
   return result;
 }
 
+jboolean Context::executePendingJobs(JNIEnv* env, jint maxJobs, jlong budgetNanos) {
+  JSContext* jobContext;
+  if (JS_ExecutePendingJobs(jsRuntime, maxJobs, budgetNanos, &jobContext) < 0) {
+    throwJsException(env, JS_EXCEPTION);
+    return JNI_FALSE;
+  }
+  return JS_IsJobPending(jsRuntime) ? JNI_TRUE : JNI_FALSE;
+}
+
 jbyteArray Context::compile(JNIEnv* env, jstring source, jstring file) {
   const auto sourceCode = env->GetStringUTFChars(source, 0);
   const auto fileName = env->GetStringUTFChars(file, 0);
@@ -249,6 +357,37 @@ jobject Context::memoryUsage(JNIEnv* env) {
   ));
 }
 
+jobject Context::gcStats(JNIEnv* env) {
+  JSGCStats jsGcStats;
+  JS_GetGCStats(jsRuntime, &jsGcStats);
+
+  return env->NewObject(
+    gcStatsClass,
+    gcStatsConstructor,
+    static_cast<jlong>(jsGcStats.full_gc_count),
+    static_cast<jlong>(jsGcStats.minor_gc_count),
+    static_cast<jlong>(jsGcStats.pause_total_ns),
+    static_cast<jlong>(jsGcStats.pause_max_ns),
+    static_cast<jlong>(jsGcStats.full_gc_freed_count),
+    static_cast<jlong>(jsGcStats.minor_gc_freed_count),
+    static_cast<jlong>(jsGcStats.alloc_count),
+    static_cast<jlong>(jsGcStats.alloc_size)
+  );
+}
+
+void Context::setGcListener(JNIEnv* env, jobject newGcListener) {
+  jobject oldGcListener = gcListener;
+  if (oldGcListener != nullptr) {
+    env->DeleteGlobalRef(oldGcListener);
+  }
+  gcListener = newGcListener != nullptr ? env->NewGlobalRef(newGcListener) : nullptr;
+  if (gcListener != nullptr) {
+    JS_SetGCCallback(jsRuntime, &jsGcCallback, this);
+  } else {
+    JS_SetGCCallback(jsRuntime, NULL, NULL);
+  }
+}
+
 void Context::setMemoryLimit(JNIEnv* env, jlong limit) {
   JS_SetMemoryLimit(jsRuntime, limit);
 }
@@ -257,6 +396,22 @@ void Context::setGcThreshold(JNIEnv* env, jlong gcThreshold) {
   JS_SetGCThreshold(jsRuntime, gcThreshold);
 }
 
+void Context::setGcPolicy(JNIEnv* env, jint gcPolicy) {
+  JS_SetGCPolicy(jsRuntime, gcPolicy);
+}
+
+void Context::setGenerationalGc(JNIEnv* env, jboolean generationalGc) {
+  JS_SetGenerationalGC(jsRuntime, generationalGc);
+}
+
+void Context::setIncrementalGc(JNIEnv* env, jboolean incrementalGc) {
+  JS_SetIncrementalGC(jsRuntime, incrementalGc);
+}
+
+void Context::setDeferredFree(JNIEnv* env, jboolean deferredFree) {
+  JS_SetDeferredFree(jsRuntime, deferredFree);
+}
+
 void Context::setMaxStackSize(JNIEnv* env, jlong stackSize) {
   JS_SetMaxStackSize(jsRuntime, stackSize);
 }
@@ -265,6 +420,90 @@ void Context::gc(JNIEnv* env) {
   JS_RunGC(jsRuntime);
 }
 
+jboolean Context::gcStep(JNIEnv* env, jlong budgetNanos) {
+  return JS_RunGCStep(jsRuntime, budgetNanos) ? JNI_TRUE : JNI_FALSE;
+}
+
+void Context::setArrayBuffer(JNIEnv* env, jstring name, jobject buffer, jobject onRelease) {
+  auto data = static_cast<uint8_t*>(env->GetDirectBufferAddress(buffer));
+  const auto size = env->GetDirectBufferCapacity(buffer);
+  if (data == nullptr && size != 0) {
+    throwJavaException(env, "java/lang/IllegalArgumentException", "buffer is not direct");
+    return;
+  }
+
+  auto externalArrayBuffer = new ExternalArrayBuffer();
+  externalArrayBuffer->buffer = env->NewGlobalRef(buffer);
+  externalArrayBuffer->onRelease = onRelease != nullptr ? env->NewGlobalRef(onRelease) : nullptr;
+  auto arrayBuffer = JS_NewArrayBuffer(jsContext, data, size, jsFreeExternalArrayBuffer,
+                                       externalArrayBuffer, false);
+  if (JS_IsException(arrayBuffer)) {
+    // QuickJS doesn't call the free function if it fails to create the ArrayBuffer.
+    if (externalArrayBuffer->onRelease != nullptr) {
+      env->DeleteGlobalRef(externalArrayBuffer->onRelease);
+    }
+    env->DeleteGlobalRef(externalArrayBuffer->buffer);
+    delete externalArrayBuffer;
+    throwJsException(env, arrayBuffer);
+    return;
+  }
+
+  auto global = JS_GetGlobalObject(jsContext);
+  const char* nameStr = env->GetStringUTFChars(name, 0);
+  if (JS_SetPropertyStr(jsContext, global, nameStr, arrayBuffer) < 0) {
+    throwJsException(env, JS_EXCEPTION);
+  }
+  env->ReleaseStringUTFChars(name, nameStr);
+  JS_FreeValue(jsContext, global);
+}
+
+jobject Context::getArrayBuffer(JNIEnv* env, jstring name) {
+  auto global = JS_GetGlobalObject(jsContext);
+  const char* nameStr = env->GetStringUTFChars(name, 0);
+  auto arrayBuffer = JS_GetPropertyStr(jsContext, global, nameStr);
+  env->ReleaseStringUTFChars(name, nameStr);
+  JS_FreeValue(jsContext, global);
+
+  if (JS_IsException(arrayBuffer)) {
+    throwJsException(env, arrayBuffer);
+    return nullptr;
+  }
+
+  size_t size = 0;
+  uint8_t* data = JS_IsObject(arrayBuffer) ? JS_GetArrayBuffer(jsContext, &size, arrayBuffer)
+                                           : nullptr;
+  if (data == nullptr) {
+    // Not an ArrayBuffer, or a detached one.
+    JS_FreeValue(jsContext, JS_GetException(jsContext));
+    JS_FreeValue(jsContext, arrayBuffer);
+    return nullptr;
+  }
+
+  // Keep the memory alive until releaseArrayBuffer() is called with the returned buffer. Each
+  // ArrayBuffer is retained once, and counts how many returned buffers share its memory.
+  auto retained = retainedArrayBuffers.find(data);
+  if (retained != retainedArrayBuffers.end()) {
+    retained->second.second++;
+    JS_FreeValue(jsContext, arrayBuffer);
+  } else {
+    retainedArrayBuffers[data] = std::make_pair(arrayBuffer, 1);
+  }
+  return env->NewDirectByteBuffer(data, size);
+}
+
+void Context::releaseArrayBuffer(JNIEnv* env, jobject buffer) {
+  auto retained = retainedArrayBuffers.find(env->GetDirectBufferAddress(buffer));
+  if (retained == retainedArrayBuffers.end()) {
+    throwJavaException(env, "java/lang/IllegalArgumentException",
+                       "buffer wasn't returned by getArrayBuffer() or was already released");
+    return;
+  }
+  if (--retained->second.second == 0) {
+    JS_FreeValue(jsContext, retained->second.first);
+    retainedArrayBuffers.erase(retained);
+  }
+}
+
 InboundCallChannel* Context::getInboundCallChannel(JNIEnv* env, jstring name) {
   JSValue global = JS_GetGlobalObject(jsContext);
 
@@ -496,7 +735,7 @@ std::string Context::toCppString(JNIEnv* env, jstring string) const {
 
 JSValue Context::toJsString(JNIEnv* env, jstring javaString) const {
   std::string cppString = this->toCppString(env, javaString);
-  return JS_NewString(this->jsContext, cppString.c_str());
+  return JS_NewStringInterned(this->jsContext, cppString.data(), cppString.size());
 }
 
 /*
@@ -33,14 +33,28 @@ public:
 
   InboundCallChannel* getInboundCallChannel(JNIEnv*, jstring name);
   void setOutboundCallChannel(JNIEnv*, jstring name, jobject callChannel);
+  void initTimers(JNIEnv*, jobject timerScheduler);
+  void startTimers(JNIEnv*, jint bucketId);
+  void runTimers(JNIEnv*, jint bucketId);
   jobject execute(JNIEnv*, jbyteArray byteCode);
+  jboolean executePendingJobs(JNIEnv*, jint maxJobs, jlong budgetNanos);
   jbyteArray compile(JNIEnv*, jstring source, jstring file);
   void setInterruptHandler(JNIEnv* env, jobject interruptHandler);
   jobject memoryUsage(JNIEnv*);
+  jobject gcStats(JNIEnv*);
+  void setGcListener(JNIEnv* env, jobject gcListener);
   void setMemoryLimit(JNIEnv* env, jlong limit);
   void setGcThreshold(JNIEnv* env, jlong gcThreshold);
+  void setGcPolicy(JNIEnv* env, jint gcPolicy);
+  void setGenerationalGc(JNIEnv* env, jboolean generationalGc);
+  void setIncrementalGc(JNIEnv* env, jboolean incrementalGc);
+  void setDeferredFree(JNIEnv* env, jboolean deferredFree);
   void gc(JNIEnv* env);
+  jboolean gcStep(JNIEnv* env, jlong budgetNanos);
   void setMaxStackSize(JNIEnv* env, jlong stackSize);
+  void setArrayBuffer(JNIEnv* env, jstring name, jobject buffer, jobject onRelease);
+  jobject getArrayBuffer(JNIEnv* env, jstring name);
+  void releaseArrayBuffer(JNIEnv* env, jobject buffer);
 
   jobject toJavaObject(JNIEnv*, const JSValue& value, bool throwOnUnsupportedType = true);
   void throwJsException(JNIEnv*, const JSValue& value) const;
@@ -79,8 +93,17 @@ public:
   jclass interruptHandlerClass;
   jmethodID interruptHandlerPoll;
   jobject interruptHandler;
+  jclass gcStatsClass;
+  jmethodID gcStatsConstructor;
+  jclass gcListenerClass;
+  jmethodID gcListenerGcCompleted;
+  jobject gcListener;
+  jobject timerScheduler;
+  jmethodID timerSchedulerScheduleTimers;
+  JSValue timers;
   std::vector<InboundCallChannel*> callChannels;
   std::unordered_map<std::string, jclass> globalReferences;
+  std::unordered_map<void*, std::pair<JSValue, int>> retainedArrayBuffers;
 };
 
 #endif //QUICKJS_ANDROID_CONTEXT_H
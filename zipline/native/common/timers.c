@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2026 Block, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stddef.h>
+#include "../quickjs/quickjs.h"
+#include "../quickjs/list.h"
+#include "timers.h"
+
+// This file implements setTimeout() and clearTimeout() natively, so registering, canceling and
+// running a timer doesn't cross the bridge to the host.
+//
+// The host's coroutine dispatcher owns time, so there's no clock here. Instead timers are grouped
+// into buckets: timers with the same delay registered before the host starts waiting share a
+// bucket. The host makes one delay() call per bucket and then runs all of its timers in one call.
+// This is the same schedule as one delay() per timer, without a host coroutine for each.
+
+JSClassID timersClassId = 0;
+
+typedef struct Timer {
+  struct list_head link; // In its bucket, in registration order.
+  struct Timer* hashNext;
+  int32_t id;
+  JSValue handler;
+  int argc;
+  JSValue argv[0];
+} Timer;
+
+typedef struct TimerBucket {
+  struct list_head link; // In Timers.buckets.
+  struct list_head timers;
+  int32_t id;
+  int32_t delayMillis;
+  int started;
+} TimerBucket;
+
+typedef struct Timers {
+  ScheduleTimersFunc* scheduleTimers;
+  void* opaque;
+  struct list_head buckets;
+  Timer** hash; // Timer IDs to timers, for clearTimeout().
+  uint32_t hashSize;
+  uint32_t count;
+  int32_t nextTimerId;
+  int32_t nextBucketId;
+} Timers;
+
+static Timer** timerHashSlot(Timers* timers, int32_t id) {
+  return &timers->hash[(uint32_t) id & (timers->hashSize - 1)];
+}
+
+static int timerHashAdd(JSContext* jsContext, Timers* timers, Timer* timer) {
+  if (timers->count >= timers->hashSize) {
+    uint32_t newSize = timers->hashSize ? timers->hashSize * 2 : 16;
+    Timer** newHash = js_mallocz(jsContext, sizeof(Timer*) * newSize);
+    if (!newHash) {
+      return -1;
+    }
+    for (uint32_t i = 0; i < timers->hashSize; i++) {
+      Timer* next;
+      for (Timer* t = timers->hash[i]; t != NULL; t = next) {
+        next = t->hashNext;
+        Timer** slot = &newHash[(uint32_t) t->id & (newSize - 1)];
+        t->hashNext = *slot;
+        *slot = t;
+      }
+    }
+    js_free(jsContext, timers->hash);
+    timers->hash = newHash;
+    timers->hashSize = newSize;
+  }
+  Timer** slot = timerHashSlot(timers, timer->id);
+  timer->hashNext = *slot;
+  *slot = timer;
+  timers->count++;
+  return 0;
+}
+
+/* Unlinks the timer with 'id' from the hash and its bucket, and returns it. */
+static Timer* timerRemove(Timers* timers, int32_t id) {
+  if (timers->hashSize == 0) {
+    return NULL;
+  }
+  for (Timer** p = timerHashSlot(timers, id); *p != NULL; p = &(*p)->hashNext) {
+    Timer* timer = *p;
+    if (timer->id == id) {
+      *p = timer->hashNext;
+      list_del(&timer->link);
+      timers->count--;
+      return timer;
+    }
+  }
+  return NULL;
+}
+
+static void timerFree(JSRuntime* jsRuntime, Timer* timer) {
+  JS_FreeValueRT(jsRuntime, timer->handler);
+  for (int i = 0; i < timer->argc; i++) {
+    JS_FreeValueRT(jsRuntime, timer->argv[i]);
+  }
+  js_free_rt(jsRuntime, timer);
+}
+
+static TimerBucket* findBucket(Timers* timers, int32_t bucketId) {
+  struct list_head* el;
+  list_for_each(el, &timers->buckets) {
+    TimerBucket* bucket = list_entry(el, TimerBucket, link);
+    if (bucket->id == bucketId) {
+      return bucket;
+    }
+  }
+  return NULL;
+}
+
+/* Returns the bucket that a timer registered now with 'delayMillis' should join. */
+static TimerBucket* openBucket(JSContext* jsContext, Timers* timers, int32_t delayMillis) {
+  struct list_head* el;
+  list_for_each(el, &timers->buckets) {
+    TimerBucket* bucket = list_entry(el, TimerBucket, link);
+    if (!bucket->started && bucket->delayMillis == delayMillis) {
+      return bucket;
+    }
+  }
+
+  TimerBucket* bucket = js_malloc(jsContext, sizeof(TimerBucket));
+  if (!bucket) {
+    return NULL;
+  }
+  init_list_head(&bucket->timers);
+  bucket->id = timers->nextBucketId++;
+  bucket->delayMillis = delayMillis;
+  bucket->started = 0;
+  if (timers->scheduleTimers(timers->opaque, bucket->id, delayMillis) < 0) {
+    js_free(jsContext, bucket);
+    return NULL;
+  }
+  list_add_tail(&bucket->link, &timers->buckets);
+  return bucket;
+}
+
+static void jsTimersFinalizer(JSRuntime* jsRuntime, JSValue val) {
+  Timers* timers = JS_GetOpaque(val, timersClassId);
+  struct list_head *el, *el1, *tl, *tl1;
+  list_for_each_safe(el, el1, &timers->buckets) {
+    TimerBucket* bucket = list_entry(el, TimerBucket, link);
+    list_for_each_safe(tl, tl1, &bucket->timers) {
+      timerFree(jsRuntime, list_entry(tl, Timer, link));
+    }
+    js_free_rt(jsRuntime, bucket);
+  }
+  js_free_rt(jsRuntime, timers->hash);
+  js_free_rt(jsRuntime, timers);
+}
+
+static void jsTimersMark(JSRuntime* jsRuntime, JSValueConst val, JS_MarkFunc* markFunc) {
+  Timers* timers = JS_GetOpaque(val, timersClassId);
+  struct list_head *el, *tl;
+  list_for_each(el, &timers->buckets) {
+    TimerBucket* bucket = list_entry(el, TimerBucket, link);
+    list_for_each(tl, &bucket->timers) {
+      Timer* timer = list_entry(tl, Timer, link);
+      JS_MarkValue(jsRuntime, timer->handler, markFunc);
+      for (int i = 0; i < timer->argc; i++) {
+        JS_MarkValue(jsRuntime, timer->argv[i], markFunc);
+      }
+    }
+  }
+}
+
+/*
+ * function app_cash_zipline_setTimeout(handler, delay, ...arguments) {
+ *   const timer = new Timer(handler, arguments);
+ *   openBucket(delay).timers.push(timer);
+ *   return timer.id;
+ * }
+ */
+static JSValue jsSetTimeout(JSContext* jsContext, JSValueConst this_val, int argc,
+                            JSValueConst* argv, int magic, JSValue* data) {
+  Timers* timers = JS_GetOpaque(data[0], timersClassId);
+
+  if (argc < 1 || !JS_IsFunction(jsContext, argv[0])) {
+    return JS_ThrowTypeError(jsContext, "handler is not a function");
+  }
+
+  double delay = 0.0;
+  if (argc >= 2 && JS_ToFloat64(jsContext, &delay, argv[1])) {
+    return JS_EXCEPTION;
+  }
+  int32_t delayMillis = 0;
+  if (delay >= INT32_MAX) {
+    delayMillis = INT32_MAX;
+  } else if (delay > 0.0) {
+    delayMillis = (int32_t) delay;
+  } // Otherwise NaN or negative.
+
+  int timerArgc = argc > 2 ? argc - 2 : 0;
+  Timer* timer = js_malloc(jsContext, sizeof(Timer) + sizeof(JSValue) * timerArgc);
+  if (!timer) {
+    return JS_EXCEPTION;
+  }
+  timer->id = timers->nextTimerId;
+  TimerBucket* bucket = openBucket(jsContext, timers, delayMillis);
+  if (!bucket || timerHashAdd(jsContext, timers, timer) < 0) {
+    js_free(jsContext, timer);
+    return JS_EXCEPTION;
+  }
+  timers->nextTimerId = timers->nextTimerId < INT32_MAX ? timers->nextTimerId + 1 : 1;
+
+  timer->handler = JS_DupValue(jsContext, argv[0]);
+  timer->argc = timerArgc;
+  for (int i = 0; i < timerArgc; i++) {
+    timer->argv[i] = JS_DupValue(jsContext, argv[i + 2]);
+  }
+  list_add_tail(&timer->link, &bucket->timers);
+
+  return JS_NewInt32(jsContext, timer->id);
+}
+
+/*
+ * function app_cash_zipline_clearTimeout(id) {
+ *   timers.remove(id);
+ * }
+ */
+static JSValue jsClearTimeout(JSContext* jsContext, JSValueConst this_val, int argc,
+                              JSValueConst* argv, int magic, JSValue* data) {
+  Timers* timers = JS_GetOpaque(data[0], timersClassId);
+
+  int32_t id;
+  if (argc < 1 || !JS_IsNumber(argv[0]) || JS_ToInt32(jsContext, &id, argv[0])) {
+    return JS_UNDEFINED; // Like browsers, ignore IDs that aren't timers.
+  }
+
+  Timer* timer = timerRemove(timers, id);
+  if (timer) {
+    timerFree(JS_GetRuntime(jsContext), timer);
+  }
+  return JS_UNDEFINED;
+}
+
+static int defineGlobalFunction(JSContext* jsContext, JSValueConst global, const char* name,
+                                JSCFunctionData* function, int length, JSValue timers) {
+  JSValue value = JS_NewCFunctionData(jsContext, function, length, 0, 1, &timers);
+  if (JS_IsException(value)) {
+    return -1;
+  }
+  return JS_SetPropertyStr(jsContext, global, name, value);
+}
+
+/*
+ * Declares globalThis.app_cash_zipline_setTimeout() and globalThis.app_cash_zipline_clearTimeout().
+ * The guest's bridge uses these instead of calling the host when they're present.
+ *
+ * Returns the object that holds the timers, to pass to startTimers() and runTimers(). The caller
+ * must free it before freeing the context. Returns JS_EXCEPTION on failure.
+ */
+JSValue installTimers(JSContext* jsContext, ScheduleTimersFunc* scheduleTimers, void* opaque) {
+  JSRuntime* jsRuntime = JS_GetRuntime(jsContext);
+
+  if (timersClassId == 0) {
+    JS_NewClassID(&timersClassId);
+  }
+  if (!JS_IsRegisteredClass(jsRuntime, timersClassId)) {
+    JSClassDef classDef = {0};
+    classDef.class_name = "Timers";
+    classDef.finalizer = jsTimersFinalizer;
+    classDef.gc_mark = jsTimersMark;
+    if (JS_NewClass(jsRuntime, timersClassId, &classDef) < 0) {
+      return JS_EXCEPTION;
+    }
+  }
+
+  Timers* timers = js_mallocz(jsContext, sizeof(Timers));
+  if (!timers) {
+    return JS_EXCEPTION;
+  }
+  timers->scheduleTimers = scheduleTimers;
+  timers->opaque = opaque;
+  init_list_head(&timers->buckets);
+  timers->nextTimerId = 1;
+  timers->nextBucketId = 1;
+
+  JSValue result = JS_NewObjectClass(jsContext, timersClassId);
+  if (JS_IsException(result)) {
+    js_free(jsContext, timers);
+    return result;
+  }
+  JS_SetOpaque(result, timers);
+
+  JSValue global = JS_GetGlobalObject(jsContext);
+  if (defineGlobalFunction(jsContext, global, "app_cash_zipline_setTimeout", jsSetTimeout, 2,
+                           result) < 0
+      || defineGlobalFunction(jsContext, global, "app_cash_zipline_clearTimeout", jsClearTimeout, 1,
+                              result) < 0) {
+    JS_FreeValue(jsContext, result);
+    result = JS_EXCEPTION;
+  }
+  JS_FreeValue(jsContext, global);
+
+  return result;
+}
+
+/* Timers registered after this call go into a new bucket. */
+void startTimers(JSContext* jsContext, JSValueConst timersValue, int32_t bucketId) {
+  Timers* timers = JS_GetOpaque(timersValue, timersClassId);
+  TimerBucket* bucket = findBucket(timers, bucketId);
+  if (bucket) {
+    bucket->started = 1;
+  }
+}
+
+/*
+ * Runs the timers of the bucket in the order they were registered. If timers throw, the others
+ * still run and the first exception is rethrown.
+ *
+ * Returns the number of timers run, or -1 if any threw.
+ */
+int runTimers(JSContext* jsContext, JSValueConst timersValue, int32_t bucketId) {
+  JSRuntime* jsRuntime = JS_GetRuntime(jsContext);
+  Timers* timers = JS_GetOpaque(timersValue, timersClassId);
+  TimerBucket* bucket = findBucket(timers, bucketId);
+  if (!bucket) {
+    return 0;
+  }
+  bucket->started = 1;
+
+  int count = 0;
+  JSValue exception = JS_UNINITIALIZED;
+  while (!list_empty(&bucket->timers)) {
+    // Handlers may clear timers, including the ones that follow in this bucket.
+    Timer* timer = timerRemove(timers, list_entry(bucket->timers.next, Timer, link)->id);
+    JSValue result = JS_Call(jsContext, timer->handler, JS_UNDEFINED, timer->argc,
+                             (JSValueConst*) timer->argv);
+    if (JS_IsException(result)) {
+      JSValue thrown = JS_GetException(jsContext);
+      if (JS_IsUninitialized(exception)) {
+        exception = thrown;
+      } else {
+        JS_FreeValue(jsContext, thrown);
+      }
+    }
+    JS_FreeValue(jsContext, result);
+    timerFree(jsRuntime, timer);
+    count++;
+  }
+
+  list_del(&bucket->link);
+  js_free(jsContext, bucket);
+
+  if (!JS_IsUninitialized(exception)) {
+    JS_Throw(jsContext, exception);
+    return -1;
+  }
+  return count;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2026 Block, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef QUICKJS_ANDROID_TIMERS_H
+#define QUICKJS_ANDROID_TIMERS_H
+
+#include "../quickjs/quickjs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Called when JavaScript creates a new bucket of timers. The host should call startTimers() once
+ * it starts waiting, and runTimers() once 'delayMillis' have elapsed. Returns < 0 and throws a
+ * JavaScript exception if the timers couldn't be scheduled.
+ */
+typedef int ScheduleTimersFunc(void *opaque, int32_t bucketId, int32_t delayMillis);
+
+JSValue installTimers(JSContext *jsContext, ScheduleTimersFunc *scheduleTimers, void *opaque);
+
+void startTimers(JSContext *jsContext, JSValueConst timers, int32_t bucketId);
+
+int runTimers(JSContext *jsContext, JSValueConst timers, int32_t bucketId);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif //QUICKJS_ANDROID_TIMERS_H
@@ -56,6 +56,36 @@ Java_app_cash_zipline_QuickJs_setOutboundCallChannel(JNIEnv* env, jobject thiz,
   context->setOutboundCallChannel(env, name, callChannel);
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_app_cash_zipline_QuickJs_initTimers(JNIEnv* env, jobject thiz, jlong _context, jobject timerScheduler) {
+  Context* context = reinterpret_cast<Context*>(_context);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return;
+  }
+  context->initTimers(env, timerScheduler);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_app_cash_zipline_QuickJs_startTimers(JNIEnv* env, jobject thiz, jlong _context, jint bucketId) {
+  Context* context = reinterpret_cast<Context*>(_context);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return;
+  }
+  context->startTimers(env, bucketId);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_app_cash_zipline_QuickJs_runTimers(JNIEnv* env, jobject thiz, jlong _context, jint bucketId) {
+  Context* context = reinterpret_cast<Context*>(_context);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return;
+  }
+  context->runTimers(env, bucketId);
+}
+
 extern "C" JNIEXPORT jobject JNICALL
 Java_app_cash_zipline_QuickJs_execute(JNIEnv* env, jobject thiz, jlong _context, jbyteArray bytecode) {
   Context* context = reinterpret_cast<Context*>(_context);
@@ -66,6 +96,16 @@ Java_app_cash_zipline_QuickJs_execute(JNIEnv* env, jobject thiz, jlong _context,
   return context->execute(env, bytecode);
 }
 
+extern "C" JNIEXPORT jboolean JNICALL
+Java_app_cash_zipline_QuickJs_executePendingJobs(JNIEnv* env, jobject thiz, jlong _context, jint maxJobs, jlong budgetNanos) {
+  Context* context = reinterpret_cast<Context*>(_context);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return JNI_FALSE;
+  }
+  return context->executePendingJobs(env, maxJobs, budgetNanos);
+}
+
 extern "C" JNIEXPORT jbyteArray JNICALL
 Java_app_cash_zipline_QuickJs_compile(JNIEnv* env, jobject thiz, jlong _context, jstring sourceCode, jstring fileName) {
   Context* context = reinterpret_cast<Context*>(_context);
@@ -96,6 +136,26 @@ Java_app_cash_zipline_QuickJs_memoryUsage(JNIEnv* env, jobject type, jlong conte
   return context->memoryUsage(env);
 }
 
+extern "C" JNIEXPORT jobject JNICALL
+Java_app_cash_zipline_QuickJs_gcStats(JNIEnv* env, jobject type, jlong context_) {
+  Context* context = reinterpret_cast<Context*>(context_);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return nullptr;
+  }
+  return context->gcStats(env);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_app_cash_zipline_QuickJs_setGcListener(JNIEnv* env, jobject type, jlong context_, jobject gcListener) {
+  Context* context = reinterpret_cast<Context*>(context_);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return;
+  }
+  context->setGcListener(env, gcListener);
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_app_cash_zipline_QuickJs_setMemoryLimit(JNIEnv* env, jobject type, jlong context_, jlong limit) {
   Context* context = reinterpret_cast<Context*>(context_);
@@ -116,6 +176,46 @@ Java_app_cash_zipline_QuickJs_setGcThreshold(JNIEnv* env, jobject type, jlong co
   context->setGcThreshold(env, gcThreshold);
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_app_cash_zipline_QuickJs_setGcPolicy(JNIEnv* env, jobject type, jlong context_, jint gcPolicy) {
+  Context* context = reinterpret_cast<Context*>(context_);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return;
+  }
+  context->setGcPolicy(env, gcPolicy);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_app_cash_zipline_QuickJs_setGenerationalGc(JNIEnv* env, jobject type, jlong context_, jboolean generationalGc) {
+  Context* context = reinterpret_cast<Context*>(context_);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return;
+  }
+  context->setGenerationalGc(env, generationalGc);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_app_cash_zipline_QuickJs_setIncrementalGc(JNIEnv* env, jobject type, jlong context_, jboolean incrementalGc) {
+  Context* context = reinterpret_cast<Context*>(context_);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return;
+  }
+  context->setIncrementalGc(env, incrementalGc);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_app_cash_zipline_QuickJs_setDeferredFree(JNIEnv* env, jobject type, jlong context_, jboolean deferredFree) {
+  Context* context = reinterpret_cast<Context*>(context_);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return;
+  }
+  context->setDeferredFree(env, deferredFree);
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_app_cash_zipline_QuickJs_gc(JNIEnv* env, jobject type, jlong context_) {
   Context* context = reinterpret_cast<Context*>(context_);
@@ -126,6 +226,16 @@ Java_app_cash_zipline_QuickJs_gc(JNIEnv* env, jobject type, jlong context_) {
   context->gc(env);
 }
 
+extern "C" JNIEXPORT jboolean JNICALL
+Java_app_cash_zipline_QuickJs_gcStep(JNIEnv* env, jobject type, jlong context_, jlong budgetNanos) {
+  Context* context = reinterpret_cast<Context*>(context_);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return JNI_FALSE;
+  }
+  return context->gcStep(env, budgetNanos);
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_app_cash_zipline_QuickJs_setMaxStackSize(JNIEnv* env, jobject type, jlong context_, jlong stackSize) {
   Context* context = reinterpret_cast<Context*>(context_);
@@ -136,6 +246,38 @@ Java_app_cash_zipline_QuickJs_setMaxStackSize(JNIEnv* env, jobject type, jlong c
   context->setMaxStackSize(env, stackSize);
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_app_cash_zipline_QuickJs_setArrayBuffer(JNIEnv* env, jobject type, jlong context_, jstring name,
+                                             jobject buffer, jobject onRelease) {
+  Context* context = reinterpret_cast<Context*>(context_);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return;
+  }
+  context->setArrayBuffer(env, name, buffer, onRelease);
+}
+
+extern "C" JNIEXPORT jobject JNICALL
+Java_app_cash_zipline_QuickJs_getArrayBuffer(JNIEnv* env, jobject type, jlong context_, jstring name) {
+  Context* context = reinterpret_cast<Context*>(context_);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return nullptr;
+  }
+  return context->getArrayBuffer(env, name);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_app_cash_zipline_QuickJs_releaseArrayBuffer(JNIEnv* env, jobject type, jlong context_,
+                                                 jobject buffer) {
+  Context* context = reinterpret_cast<Context*>(context_);
+  if (!context) {
+    throwJavaException(env, "java/lang/IllegalStateException", "QuickJs instance was closed");
+    return;
+  }
+  context->releaseArrayBuffer(env, buffer);
+}
+
 extern "C" JNIEXPORT jstring JNICALL
 Java_app_cash_zipline_JniCallChannel_call(JNIEnv* env, jobject thiz, jlong _context,
                                           jlong instance, jstring callJson) {
@@ -2493,6 +2493,85 @@ static intptr_t lre_exec_backtrack(REExecContext *s, uint8_t **capture,
     }
 }
 
+/* Zipline-patched: literal prefix prefilter. When an unanchored regexp
+   starts with literal chars, the candidate positions are found with
+   memchr() and the matcher is only started at them. */
+
+#define LRE_PREFIX_MAX 16
+/* the search loop emitted by lre_compile() for non sticky regexps */
+#define LRE_SEARCH_LOOP_LEN 11
+
+/* Return the number of literal chars every match starts with. */
+static int lre_get_literal_prefix(const uint8_t *bc_buf, uint16_t *prefix)
+{
+    const uint8_t *pc, *pc_end;
+    uint32_t c;
+    int n;
+
+    if (bc_buf[RE_HEADER_FLAGS] & (LRE_FLAG_STICKY | LRE_FLAG_IGNORECASE))
+        return 0;
+    pc = bc_buf + RE_HEADER_LEN;
+    pc_end = pc + get_u32(bc_buf + 3);
+    if (pc_end - pc < LRE_SEARCH_LOOP_LEN ||
+        pc[0] != REOP_split_goto_first || pc[5] != REOP_any ||
+        pc[6] != REOP_goto)
+        return 0;
+    pc += LRE_SEARCH_LOOP_LEN;
+    n = 0;
+    while (n < LRE_PREFIX_MAX && pc < pc_end) {
+        if (pc[0] == REOP_save_start || pc[0] == REOP_save_end) {
+            pc += 2;
+        } else if (pc[0] == REOP_char) {
+            c = get_u16(pc + 1);
+            if (c >= 0xd800 && c < 0xe000)
+                break;
+            prefix[n++] = c;
+            pc += 3;
+        } else {
+            break;
+        }
+    }
+    return n;
+}
+
+/* Return the first index >= 'cindex' where 'prefix' starts or -1. */
+static int lre_find_prefix(const uint8_t *cbuf, int cindex, int clen,
+                           int cbuf_type, const uint16_t *prefix, int n)
+{
+    const uint8_t *p8, *q;
+    const uint16_t *p16;
+    int i, j;
+
+    if (cbuf_type == 0) {
+        for(i = 0; i < n; i++) {
+            if (prefix[i] > 0xff)
+                return -1;
+        }
+        p8 = cbuf;
+        for(i = cindex; i <= clen - n; i++) {
+            q = memchr(p8 + i, prefix[0], clen - n + 1 - i);
+            if (!q)
+                break;
+            i = q - p8;
+            for(j = 1; j < n && p8[i + j] == prefix[j]; j++)
+                continue;
+            if (j == n)
+                return i;
+        }
+    } else {
+        p16 = (const uint16_t *)cbuf;
+        for(i = cindex; i <= clen - n; i++) {
+            if (p16[i] != prefix[0])
+                continue;
+            for(j = 1; j < n && p16[i + j] == prefix[j]; j++)
+                continue;
+            if (j == n)
+                return i;
+        }
+    }
+    return -1;
+}
+
 /* Return 1 if match, 0 if not match or -1 if error. cindex is the
    starting position of the match and must be such as 0 <= cindex <=
    clen. */
@@ -2501,8 +2580,9 @@ int lre_exec(uint8_t **capture,
              int cbuf_type, void *opaque)
 {
     REExecContext s_s, *s = &s_s;
-    int re_flags, i, alloca_size, ret;
+    int re_flags, i, alloca_size, ret, prefix_len;
     StackInt *stack_buf;
+    uint16_t prefix[LRE_PREFIX_MAX];
     
     re_flags = bc_buf[RE_HEADER_FLAGS];
     s->multi_line = (re_flags & LRE_FLAG_MULTILINE) != 0;
@@ -2528,8 +2608,28 @@ int lre_exec(uint8_t **capture,
         capture[i] = NULL;
     alloca_size = s->stack_size_max * sizeof(stack_buf[0]);
     stack_buf = alloca(alloca_size);
-    ret = lre_exec_backtrack(s, capture, stack_buf, 0, bc_buf + RE_HEADER_LEN,
-                             cbuf + (cindex << cbuf_type), FALSE);
+    prefix_len = lre_get_literal_prefix(bc_buf, prefix);
+    if (prefix_len > 0) {
+        /* run the matcher without the search loop at each candidate */
+        ret = 0;
+        for(;;) {
+            cindex = lre_find_prefix(cbuf, cindex, clen, cbuf_type,
+                                     prefix, prefix_len);
+            if (cindex < 0)
+                break;
+            ret = lre_exec_backtrack(s, capture, stack_buf, 0,
+                                     bc_buf + RE_HEADER_LEN + LRE_SEARCH_LOOP_LEN,
+                                     cbuf + (cindex << cbuf_type), FALSE);
+            if (ret != 0)
+                break;
+            for(i = 0; i < s->capture_count * 2; i++)
+                capture[i] = NULL;
+            cindex++;
+        }
+    } else {
+        ret = lre_exec_backtrack(s, capture, stack_buf, 0, bc_buf + RE_HEADER_LEN,
+                                 cbuf + (cindex << cbuf_type), FALSE);
+    }
     lre_realloc(s->opaque, s->state_stack, 0);
     return ret;
 }
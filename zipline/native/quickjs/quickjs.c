@@ -32,6 +32,7 @@
 #include <time.h>
 #include <fenv.h>
 #include <math.h>
+#include <float.h>
 #if defined(__APPLE__)
 #include <malloc/malloc.h>
 #elif defined(__linux__)
@@ -73,6 +74,28 @@
 #define CONFIG_ATOMICS
 #endif
 
+/* Zipline-patched: define to let JS_SetDeferredFree() release large
+   blocks on a background thread. Depends on the OS threads. */
+#if defined(CONFIG_ATOMICS)
+#define CONFIG_DEFERRED_FREE
+#endif
+
+/* Zipline-patched: 16 byte SIMD kernels for string and typed array
+   scanning. Scalar fallbacks are used otherwise. */
+#if defined(__SSE2__) || defined(_M_X64)
+#define CONFIG_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define CONFIG_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+/* Zipline-patched: exact double <-> decimal fast paths. They rely on
+   correctly rounded double operations (no x87 excess precision). */
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define CONFIG_FAST_DTOA
+#endif
+
 #if !defined(EMSCRIPTEN)
 /* enable stack limitation */
 #define CONFIG_STACK_CHECK
@@ -170,6 +193,8 @@ enum {
     JS_CLASS_STRING_ITERATOR,   /* u.array_iterator_data */
     JS_CLASS_REGEXP_STRING_ITERATOR,   /* u.regexp_string_iterator_data */
     JS_CLASS_GENERATOR,         /* u.generator_data */
+    JS_CLASS_FINALIZATION_REGISTRY, /* u.finrec_data */
+    JS_CLASS_WEAK_REF,          /* u.weak_ref_data */
     JS_CLASS_PROXY,             /* u.proxy_data */
     JS_CLASS_PROMISE,           /* u.promise_data */
     JS_CLASS_PROMISE_RESOLVE_FUNCTION,  /* u.promise_function_data */
@@ -205,6 +230,9 @@ typedef enum JSErrorEnum {
 #define JS_MAX_LOCAL_VARS 65536
 #define JS_STACK_SIZE_MAX 65534
 #define JS_STRING_LEN_MAX ((1 << 30) - 1)
+/* Zipline-patched: generational GC runs a full collection after this
+   many minor ones */
+#define JS_GC_MINOR_PER_FULL 8
 
 #define __exception __attribute__((warn_unused_result))
 
@@ -240,6 +268,50 @@ typedef struct {
 } JSNumericOperations;
 #endif
 
+/* Zipline-patched: short ASCII strings which recur (e.g. the keys and
+   the service names of the bridge payloads) are kept as atoms in a
+   small direct mapped cache, so that they are returned without
+   allocation and can be used as property keys without hashing. */
+#define JS_INTERN_CACHE_SIZE 256 /* must be a power of two */
+#define JS_INTERN_LEN_MAX 32
+
+typedef struct JSInternCacheEntry {
+    uint32_t hash; /* hash of the last string which missed this entry */
+    JSAtom atom; /* JS_ATOM_NULL if none */
+} JSInternCacheEntry;
+
+/* Zipline-patched: the RegExp bytecode of the recently compiled
+   patterns, shared by the RegExp objects built from the same pattern
+   and flags */
+#define JS_REGEXP_CACHE_SIZE 32
+#define JS_REGEXP_CACHE_PATTERN_MAX 4096
+
+typedef struct JSRegExpCacheEntry {
+    JSString *pattern; /* NULL if the entry is free */
+    JSString *bytecode;
+    uint32_t hash;
+    int re_flags;
+    uint32_t last_used;
+} JSRegExpCacheEntry;
+
+/* Zipline-patched: recent shape transitions of add_property() which
+   were found in the shape hash table, i.e. property sequences seen
+   before. Remembering the intermediate shapes lets the next objects
+   built the same way share them without probing the shape hash table.
+   The entries don't hold a reference to the shapes, so the cache never
+   keeps a shape or its prototype alive. Instead an entry is removed
+   when one of its shapes leaves the shape hash table, which happens
+   before a hashed shape is modified in place or freed. */
+#define JS_SHAPE_CACHE_SIZE 256 /* must be a power of two */
+#define JS_SHAPE_CACHE_PROP_MAX 32
+
+typedef struct JSShapeCacheEntry {
+    JSShape *sh; /* NULL if the entry is free */
+    JSAtom atom;
+    int prop_flags;
+    JSShape *new_sh; /* sh + (atom, prop_flags) */
+} JSShapeCacheEntry;
+
 struct JSRuntime {
     JSMallocFunctions mf;
     JSMallocState malloc_state;
@@ -252,6 +324,7 @@ struct JSRuntime {
     uint32_t *atom_hash;
     JSAtomStruct **atom_array;
     int atom_free_index; /* 0 = none */
+    void *atom_init_block; /* Zipline-patched: see JS_InitAtoms() */
 
     int class_count;    /* size of class_array */
     JSClass *class_array;
@@ -260,10 +333,49 @@ struct JSRuntime {
     /* list of JSGCObjectHeader.link. List of allocated GC objects (used
        by the garbage collector) */
     struct list_head gc_obj_list;
+    /* Zipline-patched: list of JSGCObjectHeader.link. Objects allocated
+       or mutated since the last collection, when generational GC is
+       enabled. Disjoint from gc_obj_list. */
+    struct list_head gc_young_obj_list;
+    BOOL gc_generational : 8;
+    int gc_minor_count; /* minor collections since the last full one */
+    /* Zipline-patched: in incremental mode full collections wait for
+       JS_RunGCStep() */
+    BOOL gc_incremental : 8;
+    BOOL gc_full_pending : 8;
+    size_t gc_pending_size; /* malloc_size when the full GC got pending */
+    int64_t gc_last_full_ns; /* duration of the last full GC, 0 if none */
+    /* Zipline-patched: how the next GC threshold is chosen, and what the
+       last automatic collection did */
+    int gc_policy; /* JS_GC_POLICY_x */
+    int gc_growth; /* JS_GC_POLICY_ADAPTIVE: threshold growth, in halves */
+    int64_t gc_last_pause_ns;
+    int64_t gc_last_interval_ns; /* from the end of the previous collection */
+    int64_t gc_last_end_ns;
+    size_t gc_last_size_before;
+    size_t gc_last_size_after;
+    /* Zipline-patched: see JS_GetGCStats() */
+    JSGCStats gc_stats;
+    JSGCCallback *gc_callback;
+    void *gc_callback_opaque;
+    /* Zipline-patched: see JS_SetDeferredFree() */
+    BOOL deferred_free : 8;
+    struct JSFreeBatch *free_batch; /* blocks not yet handed to the thread */
+    /* Zipline-patched: see js_intern_atom() */
+    JSInternCacheEntry intern_cache[JS_INTERN_CACHE_SIZE];
+    /* Zipline-patched: see js_compile_regexp() */
+    JSRegExpCacheEntry regexp_cache[JS_REGEXP_CACHE_SIZE];
+    uint32_t regexp_cache_clock;
+    /* Zipline-patched: see add_property() */
+    JSShapeCacheEntry shape_cache[JS_SHAPE_CACHE_SIZE];
     /* list of JSGCObjectHeader.link. Used during JS_FreeValueRT() */
     struct list_head gc_zero_ref_count_list; 
     struct list_head tmp_obj_list; /* used during GC */
     JSGCPhaseEnum gc_phase : 8;
+    /* Zipline-patched: TRUE while gc_scan() treats the WeakMap values
+       as ephemerons. */
+    BOOL gc_scan_weak : 8;
+    struct list_head gc_weak_map_list; /* list of JSMapState.gc_link, used during gc_scan() */
     size_t malloc_gc_threshold;
 #ifdef DUMP_LEAKS
     struct list_head string_list; /* list of JSString.link */
@@ -286,6 +398,19 @@ struct JSRuntime {
     void *host_promise_rejection_tracker_opaque;
     
     struct list_head job_list; /* list of JSJobEntry.link */
+    /* Zipline-patched: recycled job entries of JS_JOB_POOL_ARGC args */
+    struct list_head job_free_list; /* list of JSJobEntry.link */
+    int job_free_count;
+    /* Zipline-patched: FinalizationRegistry objects with collected
+       targets, cleaned up once the engine returns to the host */
+    struct list_head finrec_pending_list; /* list of JSFinalizationRegistryData.pending_link */
+    BOOL finrec_running;
+    /* Zipline-patched: targets returned by WeakRef.prototype.deref(),
+       kept alive until the engine returns to the host */
+    JSValue *weakref_kept;
+    int weakref_kept_count;
+    int weakref_kept_size;
+    uint64_t weakref_kept_epoch; /* incremented when the targets are released */
 
     JSModuleNormalizeFunc *module_normalize_func;
     JSModuleLoaderFunc *module_loader_func;
@@ -354,12 +479,20 @@ typedef enum {
 struct JSGCObjectHeader {
     int ref_count; /* must come first, 32-bit */
     JSGCObjectTypeEnum gc_obj_type : 4;
-    uint8_t mark : 4; /* used by the GC */
+    uint8_t mark : 3; /* used by the GC */
+    uint8_t young : 1; /* Zipline-patched: in gc_young_obj_list */
     uint8_t dummy1; /* not used by the GC */
     uint16_t dummy2; /* not used by the GC */
     struct list_head link;
 };
 
+/* Zipline-patched: the list currently holding a GC object */
+static inline struct list_head *gc_obj_list_of(JSRuntime *rt,
+                                               JSGCObjectHeader *h)
+{
+    return h->young ? &rt->gc_young_obj_list : &rt->gc_obj_list;
+}
+
 typedef struct JSVarRef {
     union {
         JSGCObjectHeader header; /* must come first */
@@ -459,6 +592,8 @@ struct JSContext {
                              const char *input, size_t input_len,
                              const char *filename, int flags, int scope_idx);
     void *user_opaque;
+    /* Zipline-patched: length of the last JSON.stringify() result */
+    uint32_t json_size_hint;
 };
 
 typedef union JSFloat64Union {
@@ -816,6 +951,11 @@ typedef struct JSJobEntry {
     JSValue argv[0];
 } JSJobEntry;
 
+/* Zipline-patched: job entries with up to JS_JOB_POOL_ARGC args (enough
+   for the promise jobs) have a fixed size and are recycled. */
+#define JS_JOB_POOL_ARGC 5
+#define JS_JOB_POOL_MAX  256
+
 typedef struct JSProperty {
     union {
         JSValue value;      /* JS_PROP_NORMAL */
@@ -855,6 +995,9 @@ struct JSShape {
        <= n <= 2^31-1. If false, the shape is guaranteed not to have
        small array index properties */
     uint8_t has_small_array_index;
+    /* Zipline-patched: number of JSRuntime.shape_cache entries
+       referencing the shape */
+    uint16_t cache_ref_count;
     uint32_t hash; /* current hash value */
     uint32_t prop_hash_mask;
     int prop_size; /* allocated properties */
@@ -887,7 +1030,7 @@ struct JSObject {
     JSShape *shape; /* prototype and property names + flag */
     JSProperty *prop; /* array of properties */
     /* byte offsets: 24/40 */
-    struct JSMapRecord *first_weak_ref; /* XXX: use a bit and an external hash table? */
+    struct JSWeakRefRecord *first_weak_ref; /* XXX: use a bit and an external hash table? */
     /* byte offsets: 28/48 */
     union {
         void *opaque;
@@ -905,6 +1048,8 @@ struct JSObject {
         struct JSArrayIteratorData *array_iterator_data; /* JS_CLASS_ARRAY_ITERATOR, JS_CLASS_STRING_ITERATOR */
         struct JSRegExpStringIteratorData *regexp_string_iterator_data; /* JS_CLASS_REGEXP_STRING_ITERATOR */
         struct JSGeneratorData *generator_data; /* JS_CLASS_GENERATOR */
+        struct JSFinalizationRegistryData *finrec_data; /* JS_CLASS_FINALIZATION_REGISTRY */
+        struct JSWeakRefData *weak_ref_data; /* JS_CLASS_WEAK_REF */
         struct JSProxyData *proxy_data; /* JS_CLASS_PROXY */
         struct JSPromiseData *promise_data; /* JS_CLASS_PROMISE */
         struct JSPromiseFunctionData *promise_function_data; /* JS_CLASS_PROMISE_RESOLVE_FUNCTION, JS_CLASS_PROMISE_REJECT_FUNCTION */
@@ -1080,6 +1225,10 @@ static void js_regexp_string_iterator_mark(JSRuntime *rt, JSValueConst val,
 static void js_generator_finalizer(JSRuntime *rt, JSValue obj);
 static void js_generator_mark(JSRuntime *rt, JSValueConst val,
                                 JS_MarkFunc *mark_func);
+static void js_finrec_finalizer(JSRuntime *rt, JSValue val);
+static void js_weakref_finalizer(JSRuntime *rt, JSValue val);
+static void js_finrec_mark(JSRuntime *rt, JSValueConst val,
+                           JS_MarkFunc *mark_func);
 static void js_promise_finalizer(JSRuntime *rt, JSValue val);
 static void js_promise_mark(JSRuntime *rt, JSValueConst val,
                                 JS_MarkFunc *mark_func);
@@ -1101,6 +1250,7 @@ static JSValue js_compile_regexp(JSContext *ctx, JSValueConst pattern,
 static JSValue js_regexp_constructor_internal(JSContext *ctx, JSValueConst ctor,
                                               JSValue pattern, JSValue bc);
 static void gc_decref(JSRuntime *rt);
+static void gc_promote_young(JSRuntime *rt);
 static int JS_NewClass1(JSRuntime *rt, JSClassID class_id,
                         const JSClassDef *class_def, JSAtom name);
 
@@ -1164,6 +1314,26 @@ static int JS_CreateProperty(JSContext *ctx, JSObject *p,
                              int flags);
 static int js_string_memcmp(const JSString *p1, const JSString *p2, int len);
 static void reset_weak_ref(JSRuntime *rt, JSObject *p);
+static BOOL gc_scan_weak_maps(JSRuntime *rt);
+static void gc_restore_weak_maps(JSRuntime *rt);
+static void js_run_gc(JSRuntime *rt);
+static void js_finrec_run_cleanups(JSRuntime *rt);
+static void js_shape_cache_remove(JSRuntime *rt, JSShape *sh);
+static void js_weakref_release_kept(JSRuntime *rt);
+
+/* Zipline-patched: release the targets kept by WeakRef.prototype.deref()
+   and run the pending FinalizationRegistry callbacks when the host
+   called into the engine and no JavaScript is running */
+static inline void js_check_finrec_cleanups(JSRuntime *rt)
+{
+    if (unlikely(rt->weakref_kept_count != 0 ||
+                 !list_empty(&rt->finrec_pending_list)) &&
+        !rt->current_stack_frame && !rt->finrec_running) {
+        js_weakref_release_kept(rt);
+        if (!list_empty(&rt->finrec_pending_list))
+            js_finrec_run_cleanups(rt);
+    }
+}
 static JSValue js_array_buffer_constructor3(JSContext *ctx,
                                             JSValueConst new_target,
                                             uint64_t len, JSClassID class_id,
@@ -1259,6 +1429,49 @@ static const JSClassExoticMethods js_proxy_exotic_methods;
 static const JSClassExoticMethods js_module_ns_exotic_methods;
 static JSClassID js_class_id_alloc = JS_CLASS_INIT_COUNT;
 
+static int64_t js_gc_clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Zipline-patched: GC policies. Return the malloc_size at which the next
+   automatic collection runs, given what the last one did. */
+static size_t js_gc_next_threshold(JSRuntime *rt)
+{
+    size_t before = rt->gc_last_size_before;
+    size_t after = rt->gc_last_size_after;
+    size_t limit = rt->malloc_state.malloc_limit;
+    size_t ceiling;
+
+    switch(rt->gc_policy) {
+    case JS_GC_POLICY_ADAPTIVE:
+        /* grow the threshold while collections reclaim less than 10%
+           of the heap or take more than 10% of the time since the
+           previous one, shrink it back when they reclaim more than half */
+        if (after > before - before / 10 ||
+            rt->gc_last_pause_ns > rt->gc_last_interval_ns / 10) {
+            rt->gc_growth = min_int(rt->gc_growth * 2, 8);
+        } else if (after < before / 2) {
+            rt->gc_growth = max_int(rt->gc_growth / 2, 1);
+        }
+        return after + (after >> 1) * rt->gc_growth;
+    case JS_GC_POLICY_MEMORY_LIMIT:
+        if (limit == (size_t)-1)
+            break;
+        /* let garbage accumulate up to 3/4 of the limit, then collect
+           each time half of the remaining headroom is used */
+        ceiling = limit - (limit >> 2);
+        if (after < ceiling)
+            return ceiling;
+        return after + (after < limit ? (limit - after) >> 1 : 0);
+    default:
+        break;
+    }
+    return after + (after >> 1);
+}
+
 static void js_trigger_gc(JSRuntime *rt, size_t size)
 {
     BOOL force_gc;
@@ -1273,9 +1486,33 @@ static void js_trigger_gc(JSRuntime *rt, size_t size)
         printf("GC: size=%" PRIu64 "\n",
                (uint64_t)rt->malloc_state.malloc_size);
 #endif
-        JS_RunGC(rt);
-        rt->malloc_gc_threshold = rt->malloc_state.malloc_size +
-            (rt->malloc_state.malloc_size >> 1);
+        int64_t start = js_gc_clock_ns();
+        rt->gc_last_size_before = rt->malloc_state.malloc_size;
+        /* Zipline-patched: in generational mode most collections only
+           scan the young generation. In incremental mode the full
+           collection is deferred to JS_RunGCStep() unless the heap
+           doubled while it was pending. */
+        if (rt->gc_incremental && rt->gc_full_pending &&
+            rt->malloc_state.malloc_size + size > 2 * rt->gc_pending_size) {
+            js_run_gc(rt);
+        } else if (rt->gc_incremental) {
+            if (!rt->gc_full_pending) {
+                rt->gc_full_pending = TRUE;
+                rt->gc_pending_size = rt->malloc_state.malloc_size;
+            }
+            if (rt->gc_generational)
+                JS_RunMinorGC(rt);
+        } else if (rt->gc_generational &&
+                   rt->gc_minor_count < JS_GC_MINOR_PER_FULL) {
+            JS_RunMinorGC(rt);
+        } else {
+            js_run_gc(rt);
+        }
+        rt->gc_last_interval_ns = start - rt->gc_last_end_ns;
+        rt->gc_last_end_ns = js_gc_clock_ns();
+        rt->gc_last_pause_ns = rt->gc_last_end_ns - start;
+        rt->gc_last_size_after = rt->malloc_state.malloc_size;
+        rt->malloc_gc_threshold = js_gc_next_threshold(rt);
     }
 }
 
@@ -1286,16 +1523,31 @@ static size_t js_malloc_usable_size_unknown(const void *ptr)
 
 void *js_malloc_rt(JSRuntime *rt, size_t size)
 {
+    rt->gc_stats.alloc_count++;
+    rt->gc_stats.alloc_size += size;
     return rt->mf.js_malloc(&rt->malloc_state, size);
 }
 
+#ifdef CONFIG_DEFERRED_FREE
+static BOOL js_deferred_free(JSRuntime *rt, void *ptr);
+static void js_deferred_free_flush(JSRuntime *rt);
+#endif
+
 void js_free_rt(JSRuntime *rt, void *ptr)
 {
+#ifdef CONFIG_DEFERRED_FREE
+    if (unlikely(rt->deferred_free) && ptr && js_deferred_free(rt, ptr))
+        return;
+#endif
     rt->mf.js_free(&rt->malloc_state, ptr);
 }
 
 void *js_realloc_rt(JSRuntime *rt, void *ptr, size_t size)
 {
+    /* Zipline-patched: a reallocation counts as a new allocation of
+       'size' bytes */
+    rt->gc_stats.alloc_count++;
+    rt->gc_stats.alloc_size += size;
     return rt->mf.js_realloc(&rt->malloc_state, ptr, size);
 }
 
@@ -1495,6 +1747,8 @@ static JSClassShortDef const js_std_class_def[] = {
     { JS_ATOM_String_Iterator, js_array_iterator_finalizer, js_array_iterator_mark }, /* JS_CLASS_STRING_ITERATOR */
     { JS_ATOM_RegExp_String_Iterator, js_regexp_string_iterator_finalizer, js_regexp_string_iterator_mark }, /* JS_CLASS_REGEXP_STRING_ITERATOR */
     { JS_ATOM_Generator, js_generator_finalizer, js_generator_mark }, /* JS_CLASS_GENERATOR */
+    { JS_ATOM_NULL, js_finrec_finalizer, js_finrec_mark }, /* JS_CLASS_FINALIZATION_REGISTRY */
+    { JS_ATOM_NULL, js_weakref_finalizer, NULL }, /* JS_CLASS_WEAK_REF */
 };
 
 static int init_class_range(JSRuntime *rt, JSClassShortDef const *tab,
@@ -1514,6 +1768,21 @@ static int init_class_range(JSRuntime *rt, JSClassShortDef const *tab,
     return 0;
 }
 
+/* Zipline-patched: name a class that has no predefined atom. Adding
+   predefined atoms would change the atom indices stored in bytecode. */
+static int js_set_class_name(JSRuntime *rt, JSClassID class_id,
+                             const char *name)
+{
+    JSAtom atom;
+
+    atom = __JS_NewAtomInit(rt, name, strlen(name), JS_ATOM_TYPE_STRING);
+    if (atom == JS_ATOM_NULL)
+        return -1;
+    JS_FreeAtomRT(rt, rt->class_array[class_id].class_name);
+    rt->class_array[class_id].class_name = atom;
+    return 0;
+}
+
 #ifdef CONFIG_BIGNUM
 static JSValue JS_ThrowUnsupportedOperation(JSContext *ctx)
 {
@@ -1618,6 +1887,8 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
     }
     rt->malloc_state = ms;
     rt->malloc_gc_threshold = 256 * 1024;
+    rt->gc_policy = JS_GC_POLICY_FIXED;
+    rt->gc_growth = 1;
 
 #ifdef CONFIG_BIGNUM
     bf_context_init(&rt->bf_ctx, js_bf_realloc, rt);
@@ -1628,6 +1899,7 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
 
     init_list_head(&rt->context_list);
     init_list_head(&rt->gc_obj_list);
+    init_list_head(&rt->gc_young_obj_list);
     init_list_head(&rt->gc_zero_ref_count_list);
     rt->gc_phase = JS_GC_PHASE_NONE;
     
@@ -1635,6 +1907,9 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
     init_list_head(&rt->string_list);
 #endif
     init_list_head(&rt->job_list);
+    init_list_head(&rt->job_free_list);
+    init_list_head(&rt->finrec_pending_list);
+    init_list_head(&rt->gc_weak_map_list);
 
     if (JS_InitAtoms(rt))
         goto fail;
@@ -1643,6 +1918,10 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
     if (init_class_range(rt, js_std_class_def, JS_CLASS_OBJECT,
                          countof(js_std_class_def)) < 0)
         goto fail;
+    if (js_set_class_name(rt, JS_CLASS_FINALIZATION_REGISTRY,
+                          "FinalizationRegistry") < 0 ||
+        js_set_class_name(rt, JS_CLASS_WEAK_REF, "WeakRef") < 0)
+        goto fail;
     rt->class_array[JS_CLASS_ARGUMENTS].exotic = &js_arguments_exotic_methods;
     rt->class_array[JS_CLASS_STRING].exotic = &js_string_exotic_methods;
     rt->class_array[JS_CLASS_MODULE_NS].exotic = &js_module_ns_exotic_methods;
@@ -1766,6 +2045,145 @@ static const JSMallocFunctions def_malloc_funcs = {
 #endif
 };
 
+#ifdef CONFIG_DEFERRED_FREE
+/* Zipline-patched: deferred free. Large blocks released with
+   js_free_rt() are accounted as freed immediately, batched, and handed
+   to a process wide thread which calls free(). Releasing big strings,
+   arrays and array buffers then costs the JS thread almost nothing. */
+#define JS_DEFERRED_FREE_MIN_SIZE   4096
+#define JS_DEFERRED_FREE_BATCH_LEN  64
+#define JS_DEFERRED_FREE_BATCH_SIZE (1 << 20)
+/* beyond this many queued batches the JS thread frees them itself */
+#define JS_DEFERRED_FREE_MAX_QUEUED 16
+
+typedef struct JSFreeBatch {
+    struct JSFreeBatch *next;
+    int count;
+    size_t size;
+    void *ptrs[JS_DEFERRED_FREE_BATCH_LEN];
+} JSFreeBatch;
+
+static pthread_mutex_t js_free_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t js_free_queue_cond = PTHREAD_COND_INITIALIZER;
+static JSFreeBatch *js_free_queue_head;
+static JSFreeBatch *js_free_queue_tail;
+static int js_free_queue_len;
+static int js_free_thread_state; /* 0 = not started, 1 = running, -1 = failed */
+
+static void js_free_batch(JSFreeBatch *b)
+{
+    int i;
+    for(i = 0; i < b->count; i++)
+        free(b->ptrs[i]);
+    free(b);
+}
+
+static void *js_free_thread(void *arg)
+{
+    JSFreeBatch *b;
+
+    pthread_mutex_lock(&js_free_queue_mutex);
+    for(;;) {
+        while (!js_free_queue_head)
+            pthread_cond_wait(&js_free_queue_cond, &js_free_queue_mutex);
+        b = js_free_queue_head;
+        js_free_queue_head = b->next;
+        if (!js_free_queue_head)
+            js_free_queue_tail = NULL;
+        js_free_queue_len--;
+        pthread_mutex_unlock(&js_free_queue_mutex);
+        js_free_batch(b);
+        pthread_mutex_lock(&js_free_queue_mutex);
+    }
+    return NULL;
+}
+
+/* return FALSE if the caller must free the batch itself */
+static BOOL js_free_queue_push(JSFreeBatch *b)
+{
+    pthread_attr_t attr;
+    pthread_t tid;
+    BOOL ret = FALSE;
+
+    pthread_mutex_lock(&js_free_queue_mutex);
+    if (js_free_thread_state == 0) {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&tid, &attr, js_free_thread, NULL) == 0)
+            js_free_thread_state = 1;
+        else
+            js_free_thread_state = -1;
+        pthread_attr_destroy(&attr);
+    }
+    if (js_free_thread_state > 0 &&
+        js_free_queue_len < JS_DEFERRED_FREE_MAX_QUEUED) {
+        b->next = NULL;
+        if (js_free_queue_tail)
+            js_free_queue_tail->next = b;
+        else
+            js_free_queue_head = b;
+        js_free_queue_tail = b;
+        js_free_queue_len++;
+        pthread_cond_signal(&js_free_queue_cond);
+        ret = TRUE;
+    }
+    pthread_mutex_unlock(&js_free_queue_mutex);
+    return ret;
+}
+
+static void js_deferred_free_flush(JSRuntime *rt)
+{
+    JSFreeBatch *b = rt->free_batch;
+
+    if (!b)
+        return;
+    rt->free_batch = NULL;
+    if (!js_free_queue_push(b))
+        js_free_batch(b);
+}
+
+/* return FALSE if 'ptr' must be freed synchronously */
+static BOOL js_deferred_free(JSRuntime *rt, void *ptr)
+{
+    JSFreeBatch *b;
+    size_t size;
+
+    size = js_def_malloc_usable_size(ptr);
+    if (size < JS_DEFERRED_FREE_MIN_SIZE)
+        return FALSE;
+    b = rt->free_batch;
+    if (!b) {
+        b = malloc(sizeof(*b));
+        if (!b)
+            return FALSE;
+        b->count = 0;
+        b->size = 0;
+        rt->free_batch = b;
+    }
+    /* same accounting as js_def_free() */
+    rt->malloc_state.malloc_count--;
+    rt->malloc_state.malloc_size -= size + MALLOC_OVERHEAD;
+    b->ptrs[b->count++] = ptr;
+    b->size += size;
+    if (b->count == JS_DEFERRED_FREE_BATCH_LEN ||
+        b->size >= JS_DEFERRED_FREE_BATCH_SIZE)
+        js_deferred_free_flush(rt);
+    return TRUE;
+}
+#endif /* CONFIG_DEFERRED_FREE */
+
+/* Zipline-patched: when enabled, large blocks are freed on a background
+   thread. Only supported with the default allocator: otherwise this is
+   a no-op. */
+void JS_SetDeferredFree(JSRuntime *rt, JS_BOOL enabled)
+{
+#ifdef CONFIG_DEFERRED_FREE
+    if (!enabled)
+        js_deferred_free_flush(rt);
+    rt->deferred_free = enabled && rt->mf.js_free == js_def_free;
+#endif
+}
+
 JSRuntime *JS_NewRuntime(void)
 {
     return JS_NewRuntime2(&def_malloc_funcs, NULL);
@@ -1782,6 +2200,34 @@ void JS_SetGCThreshold(JSRuntime *rt, size_t gc_threshold)
     rt->malloc_gc_threshold = gc_threshold;
 }
 
+/* Zipline-patched: when enabled, automatic GC only trial-decrements the
+   objects allocated or mutated since the previous collection, and
+   falls back to a full collection every JS_GC_MINOR_PER_FULL cycles. */
+void JS_SetGenerationalGC(JSRuntime *rt, JS_BOOL enabled)
+{
+    if (!enabled)
+        gc_promote_young(rt);
+    rt->gc_generational = (enabled != 0);
+    rt->gc_minor_count = 0;
+}
+
+/* Zipline-patched: when enabled, crossing the GC threshold only runs a
+   minor collection (in generational mode) and leaves the full one
+   pending until the host calls JS_RunGCStep() */
+void JS_SetIncrementalGC(JSRuntime *rt, JS_BOOL enabled)
+{
+    rt->gc_incremental = (enabled != 0);
+}
+
+/* Zipline-patched: choose how the threshold of the next automatic
+   collection is computed. JS_SetGCThreshold() still sets the current
+   threshold, and -1 still disables automatic GC. */
+void JS_SetGCPolicy(JSRuntime *rt, int policy)
+{
+    rt->gc_policy = policy;
+    rt->gc_growth = 1;
+}
+
 #define malloc(s) malloc_is_forbidden(s)
 #define free(p) free_is_forbidden(p)
 #define realloc(p,s) realloc_is_forbidden(p,s)
@@ -1811,9 +2257,16 @@ int JS_EnqueueJob(JSContext *ctx, JSJobFunc *job_func,
     JSJobEntry *e;
     int i;
 
-    e = js_malloc(ctx, sizeof(*e) + argc * sizeof(JSValue));
-    if (!e)
-        return -1;
+    if (argc <= JS_JOB_POOL_ARGC && !list_empty(&rt->job_free_list)) {
+        e = list_entry(rt->job_free_list.next, JSJobEntry, link);
+        list_del(&e->link);
+        rt->job_free_count--;
+    } else {
+        e = js_malloc(ctx, sizeof(*e) + max_int(argc, JS_JOB_POOL_ARGC) *
+                      sizeof(JSValue));
+        if (!e)
+            return -1;
+    }
     e->ctx = ctx;
     e->job_func = job_func;
     e->argc = argc;
@@ -1829,21 +2282,24 @@ BOOL JS_IsJobPending(JSRuntime *rt)
     return !list_empty(&rt->job_list);
 }
 
-/* return < 0 if exception, 0 if no job pending, 1 if a job was
-   executed successfully. the context of the job is stored in '*pctx' */
-int JS_ExecutePendingJob(JSRuntime *rt, JSContext **pctx)
+static void js_free_job_entry(JSRuntime *rt, JSJobEntry *e)
+{
+    if (e->argc <= JS_JOB_POOL_ARGC && rt->job_free_count < JS_JOB_POOL_MAX) {
+        list_add(&e->link, &rt->job_free_list);
+        rt->job_free_count++;
+    } else {
+        js_free_rt(rt, e);
+    }
+}
+
+/* run the first pending job. return < 0 if exception, 1 if OK */
+static int js_execute_job(JSRuntime *rt, JSContext **pctx)
 {
     JSContext *ctx;
     JSJobEntry *e;
     JSValue res;
     int i, ret;
 
-    if (list_empty(&rt->job_list)) {
-        *pctx = NULL;
-        return 0;
-    }
-
-    /* get the first pending job and execute it */
     e = list_entry(rt->job_list.next, JSJobEntry, link);
     list_del(&e->link);
     ctx = e->ctx;
@@ -1855,11 +2311,52 @@ int JS_ExecutePendingJob(JSRuntime *rt, JSContext **pctx)
     else
         ret = 1;
     JS_FreeValue(ctx, res);
-    js_free(ctx, e);
+    js_free_job_entry(rt, e);
     *pctx = ctx;
     return ret;
 }
 
+/* return < 0 if exception, 0 if no job pending, 1 if a job was
+   executed successfully. the context of the job is stored in '*pctx' */
+int JS_ExecutePendingJob(JSRuntime *rt, JSContext **pctx)
+{
+    if (list_empty(&rt->job_list)) {
+        *pctx = NULL;
+        return 0;
+    }
+    return js_execute_job(rt, pctx);
+}
+
+/* Zipline-patched: run pending jobs until the queue is empty, 'max_jobs'
+   jobs were executed or 'budget_ns' nanoseconds elapsed. A limit <= 0
+   means no limit. Return the number of jobs executed, or < 0 if a job
+   threw; the context of that job is stored in '*pctx'. */
+int JS_ExecutePendingJobs(JSRuntime *rt, int max_jobs, int64_t budget_ns,
+                          JSContext **pctx)
+{
+    int64_t deadline, now;
+    int count;
+
+    *pctx = NULL;
+    deadline = 0;
+    if (budget_ns > 0) {
+        now = js_gc_clock_ns();
+        if (budget_ns < INT64_MAX - now)
+            deadline = now + budget_ns;
+    }
+    for(count = 0; !list_empty(&rt->job_list); count++) {
+        if (max_jobs > 0 && count >= max_jobs)
+            break;
+        /* reading the clock costs about as much as a small job */
+        if (deadline != 0 && (count & 15) == 15 &&
+            js_gc_clock_ns() >= deadline)
+            break;
+        if (js_execute_job(rt, pctx) < 0)
+            return -1;
+    }
+    return count;
+}
+
 static inline uint32_t atom_get_free(const JSAtomStruct *p)
 {
     return (uintptr_t)p >> 1;
@@ -1940,8 +2437,27 @@ void JS_FreeRuntime(JSRuntime *rt)
         js_free_rt(rt, e);
     }
     init_list_head(&rt->job_list);
+    list_for_each_safe(el, el1, &rt->job_free_list) {
+        js_free_rt(rt, list_entry(el, JSJobEntry, link));
+    }
+    init_list_head(&rt->job_free_list);
+    rt->job_free_count = 0;
 
-    JS_RunGC(rt);
+    js_weakref_release_kept(rt);
+    js_free_rt(rt, rt->weakref_kept);
+
+    rt->gc_callback = NULL; /* Zipline-patched: the host is going away */
+    js_run_gc(rt);
+
+    for(i = 0; i < JS_INTERN_CACHE_SIZE; i++)
+        JS_FreeAtomRT(rt, rt->intern_cache[i].atom);
+    for(i = 0; i < JS_REGEXP_CACHE_SIZE; i++) {
+        JSRegExpCacheEntry *e = &rt->regexp_cache[i];
+        if (e->pattern) {
+            JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_STRING, e->pattern));
+            JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_STRING, e->bytecode));
+        }
+    }
 
 #ifdef DUMP_LEAKS
     /* leaking objects */
@@ -1983,6 +2499,7 @@ void JS_FreeRuntime(JSRuntime *rt)
     }
 #endif
     assert(list_empty(&rt->gc_obj_list));
+    assert(list_empty(&rt->gc_young_obj_list));
 
     /* free the classes */
     for(i = 0; i < rt->class_count; i++) {
@@ -2062,9 +2579,12 @@ void JS_FreeRuntime(JSRuntime *rt)
 #ifdef DUMP_LEAKS
             list_del(&p->link);
 #endif
-            js_free_rt(rt, p);
+            /* the predefined atoms are in atom_init_block */
+            if (i >= JS_ATOM_END)
+                js_free_rt(rt, p);
         }
     }
+    js_free_rt(rt, rt->atom_init_block);
     js_free_rt(rt, rt->atom_array);
     js_free_rt(rt, rt->atom_hash);
     js_free_rt(rt, rt->shape_hash);
@@ -2108,6 +2628,9 @@ void JS_FreeRuntime(JSRuntime *rt)
     }
 #endif
 
+#ifdef CONFIG_DEFERRED_FREE
+    js_deferred_free_flush(rt);
+#endif
     {
         JSMallocState ms = rt->malloc_state;
         rt->mf.js_free(&ms, rt);
@@ -2167,6 +2690,7 @@ JSContext *JS_NewContext(JSRuntime *rt)
     JS_AddIntrinsicMapSet(ctx);
     JS_AddIntrinsicTypedArrays(ctx);
     JS_AddIntrinsicPromise(ctx);
+    JS_AddIntrinsicWeakRef(ctx);
 #ifdef CONFIG_BIGNUM
     JS_AddIntrinsicBigInt(ctx);
 #endif
@@ -2584,32 +3108,119 @@ static int JS_ResizeAtomHash(JSRuntime *rt, int new_hash_size)
     return 0;
 }
 
-static int JS_InitAtoms(JSRuntime *rt)
+/* Zipline-patched: the predefined atoms are laid out once per process
+   in an immutable template holding their strings and their atom hash
+   table. Each runtime copies it instead of allocating and hashing the
+   atoms one by one. The strings themselves can't be shared between
+   runtimes because their reference counts are not atomic. */
+#define JS_ATOM_INIT_HASH_SIZE 256 /* there are at least 195 predefined atoms */
+
+typedef struct JSAtomTemplate {
+    uint32_t atom_hash[JS_ATOM_INIT_HASH_SIZE];
+    uint32_t offsets[JS_ATOM_END]; /* of the JSAtomStruct in 'block' */
+    size_t block_size;
+    /* JSAtomStruct images, including the JS_ATOM_NULL entry */
+    uint64_t block[(sizeof(js_atom_init) +
+                    JS_ATOM_END * (sizeof(JSAtomStruct) + 8)) / 8];
+} JSAtomTemplate;
+
+static JSAtomTemplate js_atom_template;
+
+static void js_atom_template_init(void)
 {
+    JSAtomTemplate *t = &js_atom_template;
+    JSAtomStruct *p;
+    const char *str;
+    size_t offset;
+    uint32_t h;
     int i, len, atom_type;
-    const char *p;
 
-    rt->atom_hash_size = 0;
-    rt->atom_hash = NULL;
-    rt->atom_count = 0;
-    rt->atom_size = 0;
-    rt->atom_free_index = 0;
-    if (JS_ResizeAtomHash(rt, 256))     /* there are at least 195 predefined atoms */
-        return -1;
+    /* JS_ATOM_NULL: empty symbol, not refcounted */
+    p = (JSAtomStruct *)t->block;
+    p->header.ref_count = 1;
+    p->atom_type = JS_ATOM_TYPE_SYMBOL;
+    t->offsets[0] = 0;
+    offset = (sizeof(JSAtomStruct) + 7) & ~7;
 
-    p = js_atom_init;
+    str = js_atom_init;
     for(i = 1; i < JS_ATOM_END; i++) {
-        if (i == JS_ATOM_Private_brand)
-            atom_type = JS_ATOM_TYPE_PRIVATE;
-        else if (i >= JS_ATOM_Symbol_toPrimitive)
+        len = strlen(str);
+        p = (JSAtomStruct *)((uint8_t *)t->block + offset);
+        p->header.ref_count = 1;
+        p->len = len;
+        memcpy(p->u.str8, str, len + 1);
+        if (i >= JS_ATOM_Symbol_toPrimitive || i == JS_ATOM_Private_brand) {
+            /* not in the hash table, hash_next is the atom index */
             atom_type = JS_ATOM_TYPE_SYMBOL;
-        else
+            h = (i == JS_ATOM_Private_brand) ?
+                JS_ATOM_HASH_PRIVATE : JS_ATOM_HASH_SYMBOL;
+            p->hash_next = i;
+        } else {
             atom_type = JS_ATOM_TYPE_STRING;
-        len = strlen(p);
-        if (__JS_NewAtomInit(rt, p, len, atom_type) == JS_ATOM_NULL)
-            return -1;
-        p = p + len + 1;
+            h = hash_string8((const uint8_t *)str, len, atom_type) &
+                JS_ATOM_HASH_MASK;
+            p->hash_next = t->atom_hash[h & (JS_ATOM_INIT_HASH_SIZE - 1)];
+            t->atom_hash[h & (JS_ATOM_INIT_HASH_SIZE - 1)] = i;
+        }
+        p->hash = h;
+        p->atom_type = atom_type;
+        t->offsets[i] = offset;
+        offset += (sizeof(JSAtomStruct) + len + 1 + 7) & ~7;
+        assert(offset <= sizeof(t->block));
+        str += len + 1;
+    }
+    t->block_size = offset;
+}
+
+static const JSAtomTemplate *js_get_atom_template(void)
+{
+#ifdef CONFIG_ATOMICS
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, js_atom_template_init);
+#else
+    static BOOL initialized;
+    if (!initialized) {
+        js_atom_template_init();
+        initialized = TRUE;
     }
+#endif
+    return &js_atom_template;
+}
+
+static int JS_InitAtoms(JSRuntime *rt)
+{
+    const JSAtomTemplate *t = js_get_atom_template();
+    uint8_t *block;
+    int i, size;
+
+    rt->atom_hash_size = JS_ATOM_INIT_HASH_SIZE;
+    rt->atom_count_resize = JS_ATOM_COUNT_RESIZE(JS_ATOM_INIT_HASH_SIZE);
+    rt->atom_hash = js_malloc_rt(rt, sizeof(t->atom_hash));
+    if (!rt->atom_hash)
+        return -1;
+    memcpy(rt->atom_hash, t->atom_hash, sizeof(t->atom_hash));
+
+    /* same size progression as __JS_NewAtom() */
+    size = JS_ATOM_END * 3 / 2;
+    rt->atom_array = js_malloc_rt(rt, sizeof(rt->atom_array[0]) * size);
+    if (!rt->atom_array)
+        return -1;
+    block = js_malloc_rt(rt, t->block_size);
+    if (!block)
+        return -1;
+    memcpy(block, t->block, t->block_size);
+    rt->atom_init_block = block;
+    for(i = 0; i < JS_ATOM_END; i++) {
+        rt->atom_array[i] = (JSAtomStruct *)(block + t->offsets[i]);
+#ifdef DUMP_LEAKS
+        list_add_tail(&rt->atom_array[i]->link, &rt->string_list);
+#endif
+    }
+    for(i = JS_ATOM_END; i < size; i++)
+        rt->atom_array[i] = atom_set_free(i == size - 1 ? 0 : i + 1);
+    rt->atom_size = size;
+    rt->atom_count = JS_ATOM_END;
+    rt->atom_free_index = JS_ATOM_END;
     return 0;
 }
 
@@ -3924,6 +4535,67 @@ JSValue JS_NewStringLen(JSContext *ctx, const char *buf, size_t buf_len)
     return JS_EXCEPTION;
 }
 
+/* Return a new reference to the atom of the ASCII string 'str' if it is
+   in the intern cache or if it missed the same cache entry last time.
+   Return JS_ATOM_NULL otherwise. */
+static JSAtom js_intern_atom(JSContext *ctx, const uint8_t *str, size_t len)
+{
+    JSRuntime *rt = ctx->rt;
+    JSInternCacheEntry *e;
+    JSAtomStruct *p;
+    JSAtom atom;
+    uint32_t h;
+
+    /* numeric strings are not string atoms */
+    if (len == 0 || len > JS_INTERN_LEN_MAX || is_digit(str[0]))
+        return JS_ATOM_NULL;
+    h = hash_string8(str, len, 0);
+    e = &rt->intern_cache[h & (JS_INTERN_CACHE_SIZE - 1)];
+    if (e->atom != JS_ATOM_NULL) {
+        p = rt->atom_array[e->atom];
+        if (p->len == len && !p->is_wide_char &&
+            memcmp(p->u.str8, str, len) == 0)
+            return JS_DupAtom(ctx, e->atom);
+    }
+    /* only intern the strings seen twice, so that unique strings do
+       not evict the recurring ones */
+    if (e->hash != h) {
+        e->hash = h;
+        return JS_ATOM_NULL;
+    }
+    atom = JS_NewAtomLen(ctx, (const char *)str, len);
+    if (atom == JS_ATOM_NULL)
+        return JS_ATOM_NULL;
+    JS_FreeAtom(ctx, e->atom);
+    e->atom = JS_DupAtom(ctx, atom);
+    return atom;
+}
+
+/* Zipline-patched: same as JS_NewStringLen() but consults the intern
+   cache for short ASCII strings. */
+JSValue JS_NewStringInterned(JSContext *ctx, const char *buf, size_t buf_len)
+{
+    JSValue val;
+    JSAtom atom;
+    size_t i;
+
+    if (buf_len <= JS_INTERN_LEN_MAX) {
+        for(i = 0; i < buf_len; i++) {
+            if ((uint8_t)buf[i] >= 0x80)
+                break;
+        }
+        if (i == buf_len) {
+            atom = js_intern_atom(ctx, (const uint8_t *)buf, buf_len);
+            if (atom != JS_ATOM_NULL) {
+                val = JS_AtomToString(ctx, atom);
+                JS_FreeAtom(ctx, atom);
+                return val;
+            }
+        }
+    }
+    return JS_NewStringLen(ctx, buf, buf_len);
+}
+
 static JSValue JS_ConcatString3(JSContext *ctx, const char *str1,
                                 JSValue str2, const char *str3)
 {
@@ -4176,12 +4848,61 @@ static JSValue JS_ConcatString1(JSContext *ctx,
     return JS_MKPTR(JS_TAG_STRING, p);
 }
 
+/* Zipline-patched: append 'p2' to 'p1' if 'p1' is not shared. Once
+   'p1' is large enough, its storage grows geometrically so that
+   repeated appends (e.g. 's += x' in a loop) take linear time. Return
+   the possibly moved 'p1' or NULL if it cannot be appended to ('p1' is
+   then left unchanged). */
+#define JS_STRING_GROW_MIN 256
+
+static JSString *js_string_append_in_place(JSContext *ctx, JSString *p1,
+                                           const JSString *p2)
+{
+    JSRuntime *rt = ctx->rt;
+    JSString *p;
+    size_t size, new_size;
+    uint32_t len;
+
+    if (p1->header.ref_count != 1 || p1->atom_type != 0 ||
+        p1->is_wide_char != p2->is_wide_char)
+        return NULL;
+    len = p1->len + p2->len;
+    if (len > JS_STRING_LEN_MAX)
+        return NULL;
+    size = sizeof(*p1) + (len << p1->is_wide_char) + 1 - p1->is_wide_char;
+    p = p1;
+    if (js_malloc_usable_size_rt(rt, p1) < size) {
+        if (p1->len < JS_STRING_GROW_MIN)
+            return NULL;
+        new_size = size + (size >> 1);
+#ifdef DUMP_LEAKS
+        list_del(&p1->link);
+#endif
+        p = js_realloc_rt(rt, p1, new_size);
+        if (!p)
+            p = js_realloc_rt(rt, p1, size);
+#ifdef DUMP_LEAKS
+        list_add_tail(&(p ? p : p1)->link, &rt->string_list);
+#endif
+        if (!p)
+            return NULL;
+    }
+    if (p->is_wide_char) {
+        memcpy(p->u.str16 + p->len, p2->u.str16, p2->len << 1);
+    } else {
+        memcpy(p->u.str8 + p->len, p2->u.str8, p2->len);
+        p->u.str8[len] = '\0';
+    }
+    p->len = len;
+    return p;
+}
+
 /* op1 and op2 are converted to strings. For convience, op1 or op2 =
    JS_EXCEPTION are accepted and return JS_EXCEPTION.  */
 static JSValue JS_ConcatString(JSContext *ctx, JSValue op1, JSValue op2)
 {
     JSValue ret;
-    JSString *p1, *p2;
+    JSString *p, *p1, *p2;
 
     if (unlikely(JS_VALUE_GET_TAG(op1) != JS_TAG_STRING)) {
         op1 = JS_ToStringFree(ctx, op1);
@@ -4204,17 +4925,9 @@ static JSValue JS_ConcatString(JSContext *ctx, JSValue op1, JSValue op2)
     if (p2->len == 0) {
         goto ret_op1;
     }
-    if (p1->header.ref_count == 1 && p1->is_wide_char == p2->is_wide_char
-    &&  js_malloc_usable_size(ctx, p1) >= sizeof(*p1) + ((p1->len + p2->len) << p2->is_wide_char) + 1 - p1->is_wide_char) {
-        /* Concatenate in place in available space at the end of p1 */
-        if (p1->is_wide_char) {
-            memcpy(p1->u.str16 + p1->len, p2->u.str16, p2->len << 1);
-            p1->len += p2->len;
-        } else {
-            memcpy(p1->u.str8 + p1->len, p2->u.str8, p2->len);
-            p1->len += p2->len;
-            p1->u.str8[p1->len] = '\0';
-        }
+    p = js_string_append_in_place(ctx, p1, p2);
+    if (p) {
+        op1 = JS_MKPTR(JS_TAG_STRING, p);
     ret_op1:
         JS_FreeValue(ctx, op2);
         return op1;
@@ -4332,6 +5045,8 @@ static void js_shape_hash_unlink(JSRuntime *rt, JSShape *sh)
         psh = &(*psh)->shape_hash_next;
     *psh = sh->shape_hash_next;
     rt->shape_hash_count--;
+    if (unlikely(sh->cache_ref_count != 0))
+        js_shape_cache_remove(rt, sh);
 }
 
 /* create a new empty shape with prototype 'proto' */
@@ -4367,6 +5082,7 @@ static no_inline JSShape *js_new_shape2(JSContext *ctx, JSObject *proto,
     sh->hash = shape_initial_hash(proto);
     sh->is_hashed = TRUE;
     sh->has_small_array_index = FALSE;
+    sh->cache_ref_count = 0;
     js_shape_hash_link(ctx->rt, sh);
     return sh;
 }
@@ -4398,6 +5114,7 @@ static JSShape *js_clone_shape(JSContext *ctx, JSShape *sh1)
     sh->header.ref_count = 1;
     add_gc_object(ctx->rt, &sh->header, JS_GC_OBJ_TYPE_SHAPE);
     sh->is_hashed = FALSE;
+    sh->cache_ref_count = 0;
     if (sh->proto) {
         JS_DupValue(ctx, JS_MKPTR(JS_TAG_OBJECT, sh->proto));
     }
@@ -4482,7 +5199,7 @@ static no_inline int resize_properties(JSContext *ctx, JSShape **psh,
         /* copy all the fields and the properties */
         memcpy(sh, old_sh,
                sizeof(JSShape) + sizeof(sh->prop[0]) * old_sh->prop_count);
-        list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+        list_add_tail(&sh->header.link, gc_obj_list_of(ctx->rt, &sh->header));
         new_hash_mask = new_hash_size - 1;
         sh->prop_hash_mask = new_hash_mask;
         memset(prop_hash_end(sh) - new_hash_size, 0,
@@ -4502,11 +5219,11 @@ static no_inline int resize_properties(JSContext *ctx, JSShape **psh,
                               get_shape_size(new_hash_size, new_size));
         if (unlikely(!sh_alloc)) {
             /* insert again in the GC list */
-            list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+            list_add_tail(&sh->header.link, gc_obj_list_of(ctx->rt, &sh->header));
             return -1;
         }
         sh = get_shape_from_alloc(sh_alloc, new_hash_size);
-        list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+        list_add_tail(&sh->header.link, gc_obj_list_of(ctx->rt, &sh->header));
     }
     *psh = sh;
     sh->prop_size = new_size;
@@ -4543,7 +5260,7 @@ static int compact_properties(JSContext *ctx, JSObject *p)
     sh = get_shape_from_alloc(sh_alloc, new_hash_size);
     list_del(&old_sh->header.link);
     memcpy(sh, old_sh, sizeof(JSShape));
-    list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+    list_add_tail(&sh->header.link, gc_obj_list_of(ctx->rt, &sh->header));
     
     memset(prop_hash_end(sh) - new_hash_size, 0,
            sizeof(prop_hash_end(sh)[0]) * new_hash_size);
@@ -4677,6 +5394,51 @@ static JSShape *find_hashed_shape_prop(JSRuntime *rt, JSShape *sh,
     return NULL;
 }
 
+static inline JSShapeCacheEntry *js_shape_cache_entry(JSRuntime *rt, JSShape *sh,
+                                                      JSAtom atom)
+{
+    uint32_t h;
+    h = shape_hash((uintptr_t)sh >> 4, atom);
+    return &rt->shape_cache[get_shape_hash(h, 32) & (JS_SHAPE_CACHE_SIZE - 1)];
+}
+
+static void js_shape_cache_clear_entry(JSShapeCacheEntry *e)
+{
+    e->sh->cache_ref_count--;
+    e->new_sh->cache_ref_count--;
+    e->sh = NULL;
+    e->new_sh = NULL;
+}
+
+static void js_shape_cache_add(JSRuntime *rt, JSShape *sh, JSAtom atom,
+                               int prop_flags, JSShape *new_sh)
+{
+    JSShapeCacheEntry *e = js_shape_cache_entry(rt, sh, atom);
+
+    if (e->sh)
+        js_shape_cache_clear_entry(e);
+    e->sh = sh;
+    e->atom = atom;
+    e->prop_flags = prop_flags;
+    e->new_sh = new_sh;
+    sh->cache_ref_count++;
+    new_sh->cache_ref_count++;
+}
+
+/* remove the entries referencing 'sh', which is leaving the shape hash
+   table */
+static void js_shape_cache_remove(JSRuntime *rt, JSShape *sh)
+{
+    JSShapeCacheEntry *e;
+    int i;
+
+    for(i = 0; i < JS_SHAPE_CACHE_SIZE && sh->cache_ref_count != 0; i++) {
+        e = &rt->shape_cache[i];
+        if (e->sh == sh || e->new_sh == sh)
+            js_shape_cache_clear_entry(e);
+    }
+}
+
 static __maybe_unused void JS_DumpShape(JSRuntime *rt, int i, JSShape *sh)
 {
     char atom_buf[ATOM_GET_STR_BUF_SIZE];
@@ -4701,6 +5463,7 @@ static __maybe_unused void JS_DumpShapes(JSRuntime *rt)
     JSObject *p;
     JSGCObjectHeader *gp;
     
+    gc_promote_young(rt);
     printf("JSShapes: {\n");
     printf("%5s %4s %14s %5s %5s %s\n", "SLOT", "REFS", "PROTO", "SIZE", "COUNT", "PROPS");
     for(i = 0; i < rt->shape_hash_size; i++) {
@@ -4741,6 +5504,9 @@ static JSValue JS_NewObjectFromShape(JSContext *ctx, JSShape *sh, JSClassID clas
     p->is_HTMLDDA = 0;
     p->first_weak_ref = NULL;
     p->u.opaque = NULL;
+    /* Zipline-patched: not in a GC list until add_gc_object(), so
+       the write barrier must skip it */
+    p->header.young = 1;
     p->shape = sh;
     p->prop = js_malloc(ctx, sizeof(JSProperty) * sh->prop_size);
     if (unlikely(!p->prop)) {
@@ -5513,6 +6279,13 @@ void __JS_FreeValueRT(JSRuntime *rt, JSValue v)
                 if (rt->gc_phase == JS_GC_PHASE_NONE) {
                     free_zero_refcount(rt);
                 }
+            } else if (p->mark == 0) {
+                /* Zipline-patched: an object outside of the
+                   collected set (only possible in a minor GC) was
+                   only referenced by the cycles being freed. Let
+                   gc_free_cycles() free it too. */
+                list_del(&p->link);
+                list_add_tail(&p->link, &rt->tmp_obj_list);
             }
         }
         break;
@@ -5560,7 +6333,8 @@ static void add_gc_object(JSRuntime *rt, JSGCObjectHeader *h,
 {
     h->mark = 0;
     h->gc_obj_type = type;
-    list_add_tail(&h->link, &rt->gc_obj_list);
+    h->young = rt->gc_generational;
+    list_add_tail(&h->link, gc_obj_list_of(rt, h));
 }
 
 static void remove_gc_object(JSGCObjectHeader *h)
@@ -5728,17 +6502,32 @@ static void gc_scan_incref_child2(JSRuntime *rt, JSGCObjectHeader *p)
 
 static void gc_scan(JSRuntime *rt)
 {
-    struct list_head *el;
+    struct list_head *el, *last;
     JSGCObjectHeader *p;
 
     /* keep the objects with a refcount > 0 and their children. */
-    list_for_each(el, &rt->gc_obj_list) {
-        p = list_entry(el, JSGCObjectHeader, link);
-        assert(p->ref_count > 0);
-        p->mark = 0; /* reset the mark for the next GC call */
-        mark_children(rt, p, gc_scan_incref_child);
+    init_list_head(&rt->gc_weak_map_list);
+    rt->gc_scan_weak = TRUE;
+    el = rt->gc_obj_list.next;
+    for(;;) {
+        while (el != &rt->gc_obj_list) {
+            p = list_entry(el, JSGCObjectHeader, link);
+            assert(p->ref_count > 0);
+            p->mark = 0; /* reset the mark for the next GC call */
+            mark_children(rt, p, gc_scan_incref_child);
+            el = el->next;
+        }
+        /* Zipline-patched: a WeakMap value is kept only if its map and
+           its key are kept. The kept values may keep other keys, so
+           iterate until no value is added. */
+        last = rt->gc_obj_list.prev;
+        if (!gc_scan_weak_maps(rt))
+            break;
+        el = last->next;
     }
-    
+    rt->gc_scan_weak = FALSE;
+    gc_restore_weak_maps(rt);
+
     /* restore the refcount of the objects to be deleted. */
     list_for_each(el, &rt->tmp_obj_list) {
         p = list_entry(el, JSGCObjectHeader, link);
@@ -5746,10 +6535,12 @@ static void gc_scan(JSRuntime *rt)
     }
 }
 
-static void gc_free_cycles(JSRuntime *rt)
+/* return the number of objects and functions freed */
+static int64_t gc_free_cycles(JSRuntime *rt)
 {
     struct list_head *el, *el1;
     JSGCObjectHeader *p;
+    int64_t freed_count = 0;
 #ifdef DUMP_GC_FREE
     BOOL header_done = FALSE;
 #endif
@@ -5776,6 +6567,7 @@ static void gc_free_cycles(JSRuntime *rt)
             JS_DumpGCObject(rt, p);
 #endif
             free_gc_object(rt, p);
+            freed_count++;
             break;
         default:
             list_del(&p->link);
@@ -5793,10 +6585,161 @@ static void gc_free_cycles(JSRuntime *rt)
     }
 
     init_list_head(&rt->gc_zero_ref_count_list);
+    return freed_count;
 }
 
-void JS_RunGC(JSRuntime *rt)
+/* Zipline-patched: generational collection. A trial decrement
+   restricted to a subset of the GC objects is sound as long as only
+   the references internal to the subset are removed: whatever keeps a
+   non zero refcount is referenced from outside of the subset. Cycles
+   spanning both generations are left to the next full collection. */
+
+/* move the young objects to gc_obj_list */
+static void gc_promote_young(JSRuntime *rt)
+{
+    struct list_head *el, *el1;
+    JSGCObjectHeader *p;
+
+    list_for_each_safe(el, el1, &rt->gc_young_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        p->young = 0;
+        list_del(&p->link);
+        list_add_tail(&p->link, &rt->gc_obj_list);
+    }
+}
+
+/* write barrier: an old GC object that gets a new reference may close a
+   cycle with young objects, so it is scanned by the next minor GC. It
+   is called when a property, an array element, a Map/Set record or a
+   detached closure variable is written. References stored by other
+   paths (e.g. a prototype changed in place, or a closure writing to a
+   variable of a suspended generator) are not tracked: cycles closed
+   through them are collected by the next full GC. So are cycles going
+   through an old object that wasn't written to, such as a closure
+   whose detached variable was assigned. */
+static inline void gc_remember_gc_obj(JSRuntime *rt, JSGCObjectHeader *h)
+{
+    if (unlikely(rt->gc_generational) && !h->young &&
+        rt->gc_phase == JS_GC_PHASE_NONE) {
+        h->young = 1;
+        list_del(&h->link);
+        list_add_tail(&h->link, &rt->gc_young_obj_list);
+    }
+}
+
+static inline void gc_remember(JSRuntime *rt, JSObject *p)
+{
+    gc_remember_gc_obj(rt, &p->header);
+}
+
+/* a variable on the stack belongs to the running frame, which is not a
+   GC object */
+static inline void set_var_ref_value(JSContext *ctx, JSVarRef *var_ref,
+                                     JSValue val)
+{
+    if (var_ref->is_detached)
+        gc_remember_gc_obj(ctx->rt, &var_ref->header);
+    set_value(ctx, var_ref->pvalue, val);
+}
+
+static void gc_decref_young_child(JSRuntime *rt, JSGCObjectHeader *p)
+{
+    if (p->young)
+        gc_decref_child(rt, p);
+}
+
+static void gc_decref_young(JSRuntime *rt)
+{
+    struct list_head *el, *el1;
+    JSGCObjectHeader *p;
+
+    init_list_head(&rt->tmp_obj_list);
+
+    list_for_each_safe(el, el1, &rt->gc_young_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        assert(p->mark == 0);
+        mark_children(rt, p, gc_decref_young_child);
+        p->mark = 1;
+        if (p->ref_count == 0) {
+            list_del(&p->link);
+            list_add_tail(&p->link, &rt->tmp_obj_list);
+        }
+    }
+}
+
+static void gc_scan_young_incref_child(JSRuntime *rt, JSGCObjectHeader *p)
+{
+    if (!p->young)
+        return;
+    p->ref_count++;
+    if (p->ref_count == 1) {
+        list_del(&p->link);
+        list_add_tail(&p->link, &rt->gc_young_obj_list);
+        p->mark = 0;
+    }
+}
+
+static void gc_scan_young_incref_child2(JSRuntime *rt, JSGCObjectHeader *p)
+{
+    if (p->young)
+        p->ref_count++;
+}
+
+static void gc_scan_young(JSRuntime *rt)
+{
+    struct list_head *el;
+    JSGCObjectHeader *p;
+
+    list_for_each(el, &rt->gc_young_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        assert(p->ref_count > 0);
+        p->mark = 0;
+        mark_children(rt, p, gc_scan_young_incref_child);
+    }
+
+    list_for_each(el, &rt->tmp_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        mark_children(rt, p, gc_scan_young_incref_child2);
+    }
+}
+
+/* Zipline-patched: update the counters of JS_GetGCStats() and notify
+   the host */
+static void gc_done(JSRuntime *rt, int64_t pause_ns)
+{
+    rt->gc_stats.pause_total_ns += pause_ns;
+    rt->gc_stats.pause_max_ns = max_int64(rt->gc_stats.pause_max_ns,
+                                          pause_ns);
+#ifdef CONFIG_DEFERRED_FREE
+    js_deferred_free_flush(rt);
+#endif
+    if (rt->gc_callback)
+        rt->gc_callback(rt, rt->gc_callback_opaque);
+}
+
+void JS_RunMinorGC(JSRuntime *rt)
+{
+    int64_t start = js_gc_clock_ns();
+
+    gc_decref_young(rt);
+    gc_scan_young(rt);
+    rt->gc_stats.minor_gc_freed_count += gc_free_cycles(rt);
+    /* the survivors become old */
+    gc_promote_young(rt);
+    rt->gc_minor_count++;
+
+    rt->gc_stats.minor_gc_count++;
+    gc_done(rt, js_gc_clock_ns() - start);
+}
+
+static void js_run_gc(JSRuntime *rt)
 {
+    int64_t start = js_gc_clock_ns();
+
+    gc_promote_young(rt);
+    rt->gc_minor_count = 0;
+    rt->gc_full_pending = FALSE;
+
     /* decrement the reference of the children of each object. mark =
        1 after this pass. */
     gc_decref(rt);
@@ -5805,7 +6748,52 @@ void JS_RunGC(JSRuntime *rt)
     gc_scan(rt);
 
     /* free the GC objects in a cycle */
-    gc_free_cycles(rt);
+    rt->gc_stats.full_gc_freed_count += gc_free_cycles(rt);
+
+    rt->gc_last_full_ns = max_int64(js_gc_clock_ns() - start, 1);
+    rt->gc_stats.full_gc_count++;
+    gc_done(rt, rt->gc_last_full_ns);
+}
+
+void JS_RunGC(JSRuntime *rt)
+{
+    js_run_gc(rt);
+    js_check_finrec_cleanups(rt);
+}
+
+/* Zipline-patched: do the pending GC work if it is expected to fit in
+   'budget_ns' nanoseconds. The young generation is collected first.
+   The full collection can't be split: it runs to completion if the
+   previous one took no longer than what remains of the budget, and
+   doesn't run at all otherwise. The budget is an admission check, not
+   a time limit. Return TRUE if some work is still pending. */
+JS_BOOL JS_RunGCStep(JSRuntime *rt, int64_t budget_ns)
+{
+    int64_t start = js_gc_clock_ns();
+
+    if (rt->gc_generational && !list_empty(&rt->gc_young_obj_list))
+        JS_RunMinorGC(rt);
+    if (rt->gc_full_pending &&
+        rt->gc_last_full_ns <= budget_ns - (js_gc_clock_ns() - start)) {
+        js_run_gc(rt);
+    }
+    js_check_finrec_cleanups(rt);
+    return rt->gc_full_pending;
+}
+
+/* Zipline-patched: unlike JS_ComputeMemoryUsage() this doesn't walk the
+   heap. */
+void JS_GetGCStats(JSRuntime *rt, JSGCStats *s)
+{
+    *s = rt->gc_stats;
+}
+
+/* Zipline-patched: the callback must not run JavaScript. It may be
+   invoked from any allocation that triggers a collection. */
+void JS_SetGCCallback(JSRuntime *rt, JSGCCallback *cb, void *opaque)
+{
+    rt->gc_callback = cb;
+    rt->gc_callback_opaque = opaque;
 }
 
 /* Return false if not an object or if the object has already been
@@ -5906,6 +6894,9 @@ void JS_ComputeMemoryUsage(JSRuntime *rt, JSMemoryUsage *s)
     int i;
     JSMemoryUsage_helper mem = { 0 }, *hp = &mem;
 
+    /* the walk below only covers gc_obj_list */
+    gc_promote_young(rt);
+
     memset(s, 0, sizeof(*s));
     s->malloc_count = rt->malloc_state.malloc_count;
     s->malloc_size = rt->malloc_state.malloc_size;
@@ -6127,6 +7118,8 @@ void JS_ComputeMemoryUsage(JSRuntime *rt, JSMemoryUsage *s)
         case JS_CLASS_SET:               /* u.map_state */
         case JS_CLASS_WEAKMAP:           /* u.map_state */
         case JS_CLASS_WEAKSET:           /* u.map_state */
+        case JS_CLASS_FINALIZATION_REGISTRY: /* u.finrec_data */
+        case JS_CLASS_WEAK_REF:          /* u.weak_ref_data */
         case JS_CLASS_MAP_ITERATOR:      /* u.map_iterator_data */
         case JS_CLASS_SET_ITERATOR:      /* u.map_iterator_data */
         case JS_CLASS_ARRAY_ITERATOR:    /* u.array_iterator_data */
@@ -6246,7 +7239,7 @@ void JS_DumpMemoryUsage(FILE *fp, const JSMemoryUsage *s, JSRuntime *rt)
                 if (obj_classes[class_id]) {
                     char buf[ATOM_GET_STR_BUF_SIZE];
                     fprintf(fp, "  %5d  %2.0d %s\n", obj_classes[class_id], class_id,
-                            JS_AtomGetStrRT(rt, buf, sizeof(buf), js_std_class_def[class_id - 1].class_name));
+                            JS_AtomGetStrRT(rt, buf, sizeof(buf), rt->class_array[class_id].class_name));
                 }
             }
             if (obj_classes[JS_CLASS_INIT_COUNT])
@@ -7979,12 +8972,22 @@ JSValue JS_GetPropertyStr(JSContext *ctx, JSValueConst this_obj,
 static JSProperty *add_property(JSContext *ctx,
                                 JSObject *p, JSAtom prop, int prop_flags)
 {
+    JSRuntime *rt = ctx->rt;
     JSShape *sh, *new_sh;
+    JSShapeCacheEntry *e;
 
+    gc_remember(ctx->rt, p);
     sh = p->shape;
     if (sh->is_hashed) {
         /* try to find an existing shape */
-        new_sh = find_hashed_shape_prop(ctx->rt, sh, prop, prop_flags);
+        e = js_shape_cache_entry(rt, sh, prop);
+        if (e->sh == sh && e->atom == prop && e->prop_flags == prop_flags) {
+            new_sh = e->new_sh;
+        } else {
+            new_sh = find_hashed_shape_prop(ctx->rt, sh, prop, prop_flags);
+            if (new_sh && new_sh->prop_count <= JS_SHAPE_CACHE_PROP_MAX)
+                js_shape_cache_add(rt, sh, prop, prop_flags, new_sh);
+        }
         if (new_sh) {
             /* matching shape found: use it */
             /*  the property array may need to be resized */
@@ -8299,6 +9302,8 @@ static int add_fast_array_element(JSContext *ctx, JSObject *p,
             return -1;
         }
     }
+    if (JS_VALUE_GET_TAG(val) == JS_TAG_OBJECT)
+        gc_remember(ctx->rt, p);
     p->u.array.u.values[new_len - 1] = val;
     p->u.array.count = new_len;
     return TRUE;
@@ -8459,6 +9464,8 @@ retry:
         if (likely((prs->flags & (JS_PROP_TMASK | JS_PROP_WRITABLE |
                                   JS_PROP_LENGTH)) == JS_PROP_WRITABLE)) {
             /* fast case */
+            if (JS_VALUE_GET_TAG(val) == JS_TAG_OBJECT)
+                gc_remember(ctx->rt, p);
             set_value(ctx, &pr->u.value, val);
             return TRUE;
         } else if (prs->flags & JS_PROP_LENGTH) {
@@ -8473,7 +9480,7 @@ retry:
                spaces. */
             if (p->class_id == JS_CLASS_MODULE_NS)
                 goto read_only_prop;
-            set_value(ctx, pr->u.var_ref->pvalue, val);
+            set_var_ref_value(ctx, pr->u.var_ref, val);
             return TRUE;
         } else if ((prs->flags & JS_PROP_TMASK) == JS_PROP_AUTOINIT) {
             /* Instantiate property and retry (potentially useless) */
@@ -8685,6 +9692,8 @@ static int JS_SetPropertyValue(JSContext *ctx, JSValueConst this_obj,
                 /* add element */
                 return add_fast_array_element(ctx, p, val, flags);
             }
+            if (JS_VALUE_GET_TAG(val) == JS_TAG_OBJECT)
+                gc_remember(ctx->rt, p);
             set_value(ctx, &p->u.array.u.values[idx], val);
             break;
         case JS_CLASS_ARGUMENTS:
@@ -9032,6 +10041,8 @@ int JS_DefineProperty(JSContext *ctx, JSValueConst this_obj,
         return -1;
     }
     p = JS_VALUE_GET_OBJ(this_obj);
+    /* Zipline-patched: the value, getter or setter may close a cycle */
+    gc_remember(ctx->rt, p);
 
  redo_prop_update:
     prs = find_own_property(&pr, p, prop);
@@ -10015,6 +11026,88 @@ static inline int to_digit(int c)
         return 36;
 }
 
+#ifdef CONFIG_FAST_DTOA
+/* exactly representable powers of ten */
+static const double js_pow10_tab[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/* Parse '[-]ddd[.ddd][e[+-]ddd]' when the result is a single correctly
+   rounded operation: a mantissa below 2^53 multiplied or divided by an
+   exact power of ten (Clinger's fast path). Return FALSE otherwise. */
+static BOOL js_strtod_fast(const char *p, double *pd)
+{
+    uint64_t m;
+    int n_digits, exp10, e, is_neg, exp_neg;
+
+    is_neg = 0;
+    if (*p == '-') {
+        is_neg = 1;
+        p++;
+    }
+    m = 0;
+    n_digits = 0;
+    exp10 = 0;
+    while (*p == '0')
+        p++;
+    while (is_digit(*p)) {
+        if (++n_digits > 19)
+            return FALSE;
+        m = m * 10 + (*p++ - '0');
+    }
+    if (*p == '.') {
+        p++;
+        if (m == 0) {
+            while (*p == '0') {
+                p++;
+                exp10--;
+            }
+        }
+        while (is_digit(*p)) {
+            if (++n_digits > 19)
+                return FALSE;
+            m = m * 10 + (*p++ - '0');
+            exp10--;
+        }
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        exp_neg = 0;
+        if (*p == '+') {
+            p++;
+        } else if (*p == '-') {
+            exp_neg = 1;
+            p++;
+        }
+        if (!is_digit(*p))
+            return FALSE;
+        e = 0;
+        while (is_digit(*p)) {
+            if (e >= 1000)
+                return FALSE;
+            e = e * 10 + (*p++ - '0');
+        }
+        exp10 += exp_neg ? -e : e;
+    }
+    if (*p != '\0')
+        return FALSE;
+    if (m == 0) {
+        *pd = is_neg ? -0.0 : 0.0;
+        return TRUE;
+    }
+    if (m > ((uint64_t)1 << 53) || exp10 < -22 || exp10 > 22)
+        return FALSE;
+    if (exp10 >= 0)
+        *pd = (double)m * js_pow10_tab[exp10];
+    else
+        *pd = (double)m / js_pow10_tab[-exp10];
+    if (is_neg)
+        *pd = -*pd;
+    return TRUE;
+}
+#endif /* CONFIG_FAST_DTOA */
+
 /* XXX: remove */
 static double js_strtod(const char *p, int radix, BOOL is_float)
 {
@@ -10059,6 +11152,10 @@ static double js_strtod(const char *p, int radix, BOOL is_float)
         if (is_neg)
             d = -d;
     } else {
+#ifdef CONFIG_FAST_DTOA
+        if (js_strtod_fast(p, &d))
+            return d;
+#endif
         d = strtod(p, NULL);
     }
     return d;
@@ -10862,6 +11959,33 @@ int JS_ToInt64Ext(JSContext *ctx, int64_t *pres, JSValueConst val)
 }
 
 /* return (<0, 0) in case of exception */
+static inline int32_t js_float64_to_int32(double d)
+{
+    JSFloat64Union u;
+    int32_t ret;
+    int e;
+
+    u.d = d;
+    /* we avoid doing fmod(x, 2^32) */
+    e = (u.u64 >> 52) & 0x7ff;
+    if (likely(e <= (1023 + 30))) {
+        /* fast case */
+        ret = (int32_t)d;
+    } else if (e <= (1023 + 30 + 53)) {
+        uint64_t v;
+        /* remainder modulo 2^32 */
+        v = (u.u64 & (((uint64_t)1 << 52) - 1)) | ((uint64_t)1 << 52);
+        v = v << ((e - 1023) - 52 + 32);
+        ret = v >> 32;
+        /* take the sign into account */
+        if (u.u64 >> 63)
+            ret = -ret;
+    } else {
+        ret = 0; /* also handles NaN and +inf */
+    }
+    return ret;
+}
+
 static int JS_ToInt32Free(JSContext *ctx, int32_t *pres, JSValue val)
 {
     uint32_t tag;
@@ -10877,30 +12001,7 @@ static int JS_ToInt32Free(JSContext *ctx, int32_t *pres, JSValue val)
         ret = JS_VALUE_GET_INT(val);
         break;
     case JS_TAG_FLOAT64:
-        {
-            JSFloat64Union u;
-            double d;
-            int e;
-            d = JS_VALUE_GET_FLOAT64(val);
-            u.d = d;
-            /* we avoid doing fmod(x, 2^32) */
-            e = (u.u64 >> 52) & 0x7ff;
-            if (likely(e <= (1023 + 30))) {
-                /* fast case */
-                ret = (int32_t)d;
-            } else if (e <= (1023 + 30 + 53)) {
-                uint64_t v;
-                /* remainder modulo 2^32 */
-                v = (u.u64 & (((uint64_t)1 << 52) - 1)) | ((uint64_t)1 << 52);
-                v = v << ((e - 1023) - 52 + 32);
-                ret = v >> 32;
-                /* take the sign into account */
-                if (u.u64 >> 63)
-                    ret = -ret;
-            } else {
-                ret = 0; /* also handles NaN and +inf */
-            }
-        }
+        ret = js_float64_to_int32(JS_VALUE_GET_FLOAT64(val));
         break;
 #ifdef CONFIG_BIGNUM
     case JS_TAG_BIG_FLOAT:
@@ -10933,6 +12034,16 @@ static inline int JS_ToUint32Free(JSContext *ctx, uint32_t *pres, JSValue val)
     return JS_ToInt32Free(ctx, (int32_t *)pres, val);
 }
 
+static inline int js_float64_to_uint8_clamp(double d)
+{
+    if (isnan(d) || d < 0)
+        return 0;
+    else if (d > 255)
+        return 255;
+    else
+        return lrint(d);
+}
+
 static int JS_ToUint8ClampFree(JSContext *ctx, int32_t *pres, JSValue val)
 {
     uint32_t tag;
@@ -10952,19 +12063,7 @@ static int JS_ToUint8ClampFree(JSContext *ctx, int32_t *pres, JSValue val)
         res = max_int(0, min_int(255, res));
         break;
     case JS_TAG_FLOAT64:
-        {
-            double d = JS_VALUE_GET_FLOAT64(val);
-            if (isnan(d)) {
-                res = 0;
-            } else {
-                if (d < 0)
-                    res = 0;
-                else if (d > 255)
-                    res = 255;
-                else
-                    res = lrint(d);
-            }
-        }
+        res = js_float64_to_uint8_clamp(JS_VALUE_GET_FLOAT64(val));
         break;
 #ifdef CONFIG_BIGNUM
     case JS_TAG_BIG_FLOAT:
@@ -11323,6 +12422,48 @@ static void js_ecvt1(double d, int n_digits, int *decpt, int *sign, char *buf,
 /* maximum buffer size for js_dtoa */
 #define JS_DTOA_BUF_SIZE 128
 
+#ifdef CONFIG_FAST_DTOA
+/* Shortest digits of 'd' when they are at most 15: the smallest k such
+   that m = round(|d| * 10^k) < 10^15 and m / 10^k == |d|. The division
+   is correctly rounded, so it gives the same double as parsing the
+   digits. With at most 15 digits, m is the only candidate for this k.
+   Return the number of digits or 0 if there is no such k. */
+static int js_ecvt_short(double d, int *decpt, int *sign, char *buf)
+{
+    double a, m;
+    int k, n, i;
+    uint64_t v;
+    char tmp[16];
+
+    a = fabs(d);
+    if (a == 0)
+        return 0;
+    for(k = 1; k <= 22; k++) {
+        m = a * js_pow10_tab[k];
+        if (m >= 1e15)
+            break;
+        m = floor(m + 0.5);
+        if (m / js_pow10_tab[k] == a) {
+            v = (uint64_t)m;
+            n = 0;
+            do {
+                tmp[n++] = '0' + (v % 10);
+                v /= 10;
+            } while (v != 0);
+            for(i = 0; i < n; i++)
+                buf[i] = tmp[n - 1 - i];
+            *decpt = n - k;
+            *sign = (d < 0);
+            while (n >= 2 && buf[n - 1] == '0')
+                n--;
+            buf[n] = '\0';
+            return n;
+        }
+    }
+    return 0;
+}
+#endif /* CONFIG_FAST_DTOA */
+
 /* needed because ecvt usually limits the number of digits to
    17. Return the number of digits. */
 static int js_ecvt(double d, int n_digits, int *decpt, int *sign, char *buf,
@@ -11333,6 +12474,11 @@ static int js_ecvt(double d, int n_digits, int *decpt, int *sign, char *buf,
 
     if (!is_fixed) {
         unsigned int n_digits_min, n_digits_max;
+#ifdef CONFIG_FAST_DTOA
+        n_digits = js_ecvt_short(d, decpt, sign, buf);
+        if (n_digits > 0)
+            return n_digits;
+#endif
         /* find the minimum amount of digits (XXX: inefficient but simple) */
         n_digits_min = 1;
         n_digits_max = 17;
@@ -16196,6 +17342,102 @@ typedef enum {
 #define FUNC_RET_YIELD      1
 #define FUNC_RET_YIELD_STAR 2
 
+/* Zipline-patched: 'pc' points after an OP_add of two strings. If the
+   instruction at 'pc' stores the result into the local variable or the
+   plain object field which holds the other reference to sp[-2], return
+   that slot: its reference can be given up so that the string is
+   appended to in place. Otherwise return NULL. */
+static JSValue *js_add_string_target(JSContext *ctx, const uint8_t *pc,
+                                     JSValue *var_buf, JSValue *sp)
+{
+    JSValue *pv;
+    JSObject *p;
+    JSProperty *pr;
+    JSShapeProperty *prs;
+
+    switch(pc[0]) {
+    case OP_put_loc:
+    case OP_set_loc:
+    case OP_put_loc_check:
+        pv = &var_buf[get_u16(pc + 1)];
+        break;
+#if SHORT_OPCODES
+    case OP_put_loc8:
+    case OP_set_loc8:
+        pv = &var_buf[pc[1]];
+        break;
+    case OP_put_loc0:
+    case OP_put_loc1:
+    case OP_put_loc2:
+    case OP_put_loc3:
+        pv = &var_buf[pc[0] - OP_put_loc0];
+        break;
+    case OP_set_loc0:
+    case OP_set_loc1:
+    case OP_set_loc2:
+    case OP_set_loc3:
+        pv = &var_buf[pc[0] - OP_set_loc0];
+        break;
+#endif
+    case OP_put_field:
+        if (JS_VALUE_GET_TAG(sp[-3]) != JS_TAG_OBJECT)
+            return NULL;
+        p = JS_VALUE_GET_OBJ(sp[-3]);
+        if (p->class_id != JS_CLASS_OBJECT)
+            return NULL;
+        prs = find_own_property(&pr, p, get_u32(pc + 1));
+        if (!prs || (prs->flags & (JS_PROP_TMASK | JS_PROP_WRITABLE)) !=
+            (JS_PROP_NORMAL | JS_PROP_WRITABLE))
+            return NULL;
+        pv = &pr->u.value;
+        break;
+    default:
+        return NULL;
+    }
+    if (JS_VALUE_GET_TAG(*pv) != JS_TAG_STRING ||
+        JS_VALUE_GET_PTR(*pv) != JS_VALUE_GET_PTR(sp[-2]))
+        return NULL;
+    return pv;
+}
+
+/* Compute sp[-2] + sp[-1] into sp[-2], appending in place to the
+   string sp[-2] whose other reference is held by '*pv'. Return 0 if
+   OK, 1 if the general path must be used or -1 if exception. */
+static int js_add_string_in_place(JSContext *ctx, JSValue *pv, JSValue *sp)
+{
+    JSString *p1, *p;
+    JSValue op2;
+
+    switch(JS_VALUE_GET_NORM_TAG(sp[-1])) {
+    case JS_TAG_STRING:
+        op2 = sp[-1];
+        break;
+    case JS_TAG_INT:
+    case JS_TAG_FLOAT64:
+    case JS_TAG_BOOL:
+    case JS_TAG_NULL:
+    case JS_TAG_UNDEFINED:
+        op2 = JS_ToString(ctx, sp[-1]);
+        if (JS_IsException(op2))
+            return -1;
+        sp[-1] = op2;
+        break;
+    default:
+        return 1;
+    }
+    p1 = JS_VALUE_GET_STRING(sp[-2]);
+    p1->header.ref_count--;
+    p = js_string_append_in_place(ctx, p1, JS_VALUE_GET_STRING(op2));
+    if (!p) {
+        p1->header.ref_count++;
+        return 1;
+    }
+    *pv = JS_UNDEFINED;
+    sp[-2] = JS_MKPTR(JS_TAG_STRING, p);
+    JS_FreeValue(ctx, op2);
+    return 0;
+}
+
 /* argv[] is modified if (flags & JS_CALL_FLAG_COPY_ARGV) = 0. */
 static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                                JSValueConst this_obj, JSValueConst new_target,
@@ -17079,14 +18321,14 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
         CASE(OP_get_var_ref1): *sp++ = JS_DupValue(ctx, *var_refs[1]->pvalue); BREAK;
         CASE(OP_get_var_ref2): *sp++ = JS_DupValue(ctx, *var_refs[2]->pvalue); BREAK;
         CASE(OP_get_var_ref3): *sp++ = JS_DupValue(ctx, *var_refs[3]->pvalue); BREAK;
-        CASE(OP_put_var_ref0): set_value(ctx, var_refs[0]->pvalue, *--sp); BREAK;
-        CASE(OP_put_var_ref1): set_value(ctx, var_refs[1]->pvalue, *--sp); BREAK;
-        CASE(OP_put_var_ref2): set_value(ctx, var_refs[2]->pvalue, *--sp); BREAK;
-        CASE(OP_put_var_ref3): set_value(ctx, var_refs[3]->pvalue, *--sp); BREAK;
-        CASE(OP_set_var_ref0): set_value(ctx, var_refs[0]->pvalue, JS_DupValue(ctx, sp[-1])); BREAK;
-        CASE(OP_set_var_ref1): set_value(ctx, var_refs[1]->pvalue, JS_DupValue(ctx, sp[-1])); BREAK;
-        CASE(OP_set_var_ref2): set_value(ctx, var_refs[2]->pvalue, JS_DupValue(ctx, sp[-1])); BREAK;
-        CASE(OP_set_var_ref3): set_value(ctx, var_refs[3]->pvalue, JS_DupValue(ctx, sp[-1])); BREAK;
+        CASE(OP_put_var_ref0): set_var_ref_value(ctx, var_refs[0], *--sp); BREAK;
+        CASE(OP_put_var_ref1): set_var_ref_value(ctx, var_refs[1], *--sp); BREAK;
+        CASE(OP_put_var_ref2): set_var_ref_value(ctx, var_refs[2], *--sp); BREAK;
+        CASE(OP_put_var_ref3): set_var_ref_value(ctx, var_refs[3], *--sp); BREAK;
+        CASE(OP_set_var_ref0): set_var_ref_value(ctx, var_refs[0], JS_DupValue(ctx, sp[-1])); BREAK;
+        CASE(OP_set_var_ref1): set_var_ref_value(ctx, var_refs[1], JS_DupValue(ctx, sp[-1])); BREAK;
+        CASE(OP_set_var_ref2): set_var_ref_value(ctx, var_refs[2], JS_DupValue(ctx, sp[-1])); BREAK;
+        CASE(OP_set_var_ref3): set_var_ref_value(ctx, var_refs[3], JS_DupValue(ctx, sp[-1])); BREAK;
 #endif
 
         CASE(OP_get_var_ref):
@@ -17105,7 +18347,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 int idx;
                 idx = get_u16(pc);
                 pc += 2;
-                set_value(ctx, var_refs[idx]->pvalue, sp[-1]);
+                set_var_ref_value(ctx, var_refs[idx], sp[-1]);
                 sp--;
             }
             BREAK;
@@ -17114,7 +18356,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 int idx;
                 idx = get_u16(pc);
                 pc += 2;
-                set_value(ctx, var_refs[idx]->pvalue, JS_DupValue(ctx, sp[-1]));
+                set_var_ref_value(ctx, var_refs[idx], JS_DupValue(ctx, sp[-1]));
             }
             BREAK;
         CASE(OP_get_var_ref_check):
@@ -17141,7 +18383,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                     JS_ThrowReferenceErrorUninitialized2(ctx, b, idx, TRUE);
                     goto exception;
                 }
-                set_value(ctx, var_refs[idx]->pvalue, sp[-1]);
+                set_var_ref_value(ctx, var_refs[idx], sp[-1]);
                 sp--;
             }
             BREAK;
@@ -17154,7 +18396,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                     JS_ThrowReferenceErrorUninitialized2(ctx, b, idx, TRUE);
                     goto exception;
                 }
-                set_value(ctx, var_refs[idx]->pvalue, sp[-1]);
+                set_var_ref_value(ctx, var_refs[idx], sp[-1]);
                 sp--;
             }
             BREAK;
@@ -17916,7 +19158,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
 
         CASE(OP_add):
             {
-                JSValue op1, op2;
+                JSValue op1, op2, *pv;
                 op1 = sp[-2];
                 op2 = sp[-1];
                 if (likely(JS_VALUE_IS_BOTH_INT(op1, op2))) {
@@ -17930,6 +19172,16 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                     sp[-2] = __JS_NewFloat64(ctx, JS_VALUE_GET_FLOAT64(op1) +
                                              JS_VALUE_GET_FLOAT64(op2));
                     sp--;
+                } else if (JS_VALUE_GET_TAG(op1) == JS_TAG_STRING &&
+                           JS_VALUE_GET_STRING(op1)->header.ref_count == 2 &&
+                           (pv = js_add_string_target(ctx, pc, var_buf, sp))) {
+                    /* 's = s + x' or 'o.s = o.s + x' */
+                    int ret = js_add_string_in_place(ctx, pv, sp);
+                    if (ret > 0)
+                        goto add_slow;
+                    if (ret < 0)
+                        goto exception;
+                    sp--;
                 } else {
                 add_slow:
                     if (js_add_slow(ctx, sp))
@@ -17961,6 +19213,20 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                     op1 = JS_ToPrimitiveFree(ctx, op1, HINT_NONE);
                     if (JS_IsException(op1))
                         goto exception;
+                    /* Zipline-patched: the variable may be the only
+                       reference to the string, so append in place
+                       before taking another one */
+                    if (JS_VALUE_GET_TAG(*pv) == JS_TAG_STRING &&
+                        JS_VALUE_GET_TAG(op1) == JS_TAG_STRING) {
+                        JSString *p;
+                        p = js_string_append_in_place(ctx, JS_VALUE_GET_STRING(*pv),
+                                                      JS_VALUE_GET_STRING(op1));
+                        if (p) {
+                            *pv = JS_MKPTR(JS_TAG_STRING, p);
+                            JS_FreeValue(ctx, op1);
+                            BREAK;
+                        }
+                    }
                     op1 = JS_ConcatString(ctx, JS_DupValue(ctx, *pv), op1);
                     if (JS_IsException(op1))
                         goto exception;
@@ -18714,8 +19980,11 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
 JSValue JS_Call(JSContext *ctx, JSValueConst func_obj, JSValueConst this_obj,
                 int argc, JSValueConst *argv)
 {
-    return JS_CallInternal(ctx, func_obj, this_obj, JS_UNDEFINED,
-                           argc, (JSValue *)argv, JS_CALL_FLAG_COPY_ARGV);
+    JSValue ret;
+    ret = JS_CallInternal(ctx, func_obj, this_obj, JS_UNDEFINED,
+                          argc, (JSValue *)argv, JS_CALL_FLAG_COPY_ARGV);
+    js_check_finrec_cleanups(ctx->rt);
+    return ret;
 }
 
 static JSValue JS_CallFree(JSContext *ctx, JSValue func_obj, JSValueConst this_obj,
@@ -18872,10 +20141,13 @@ JSValue JS_Invoke(JSContext *ctx, JSValueConst this_val, JSAtom atom,
                   int argc, JSValueConst *argv)
 {
     JSValue func_obj;
+    JSValue ret;
     func_obj = JS_GetProperty(ctx, this_val, atom);
     if (JS_IsException(func_obj))
         return func_obj;
-    return JS_CallFree(ctx, func_obj, this_val, argc, argv);
+    ret = JS_CallFree(ctx, func_obj, this_val, argc, argv);
+    js_check_finrec_cleanups(ctx->rt);
+    return ret;
 }
 
 static JSValue JS_InvokeFree(JSContext *ctx, JSValue this_val, JSAtom atom,
@@ -27236,7 +28508,7 @@ int JS_SetModuleExport(JSContext *ctx, JSModuleDef *m, const char *export_name,
     JS_FreeAtom(ctx, name);
     if (!me)
         goto fail;
-    set_value(ctx, me->u.local.var_ref->pvalue, val);
+    set_var_ref_value(ctx, me->u.local.var_ref, val);
     return 0;
  fail:
     JS_FreeValue(ctx, val);
@@ -33541,6 +34813,7 @@ static JSValue JS_EvalFunctionInternal(JSContext *ctx, JSValue fun_obj,
         JS_FreeValue(ctx, fun_obj);
         ret_val = JS_ThrowTypeError(ctx, "bytecode function expected");
     }
+    js_check_finrec_cleanups(ctx->rt);
     return ret_val;
 }
 
@@ -38619,6 +39892,101 @@ static JSValue js_array_fill(JSContext *ctx, JSValueConst this_val,
     return JS_EXCEPTION;
 }
 
+/* Zipline-patched: search the values of a fast array from 'n' to 'end'
+   (excluded) with a loop specialized on the type of 'val' instead of
+   calling js_strict_eq2() for each element. Return the index of the
+   first match, -1 if none or -2 if 'val' has no specialized loop. */
+static int64_t js_array_search_fast(JSContext *ctx, JSValueConst val,
+                                    const JSValue *arrp, int64_t n,
+                                    int64_t end, BOOL same_value_zero)
+{
+    int step = (n <= end) ? 1 : -1;
+    int tag, tag1;
+    double d;
+
+    tag = JS_VALUE_GET_NORM_TAG(val);
+    switch(tag) {
+    case JS_TAG_INT:
+        {
+            int32_t v = JS_VALUE_GET_INT(val);
+            d = v;
+            for(; n != end; n += step) {
+                tag1 = JS_VALUE_GET_NORM_TAG(arrp[n]);
+                if (tag1 == JS_TAG_INT) {
+                    if (JS_VALUE_GET_INT(arrp[n]) == v)
+                        return n;
+                } else if (tag1 == JS_TAG_FLOAT64) {
+                    if (JS_VALUE_GET_FLOAT64(arrp[n]) == d)
+                        return n;
+                }
+            }
+        }
+        break;
+    case JS_TAG_FLOAT64:
+        d = JS_VALUE_GET_FLOAT64(val);
+        if (isnan(d)) {
+            if (!same_value_zero)
+                return -1;
+            for(; n != end; n += step) {
+                if (JS_VALUE_GET_NORM_TAG(arrp[n]) == JS_TAG_FLOAT64 &&
+                    isnan(JS_VALUE_GET_FLOAT64(arrp[n])))
+                    return n;
+            }
+            break;
+        }
+        for(; n != end; n += step) {
+            tag1 = JS_VALUE_GET_NORM_TAG(arrp[n]);
+            if (tag1 == JS_TAG_FLOAT64) {
+                if (JS_VALUE_GET_FLOAT64(arrp[n]) == d)
+                    return n;
+            } else if (tag1 == JS_TAG_INT) {
+                if (JS_VALUE_GET_INT(arrp[n]) == d)
+                    return n;
+            }
+        }
+        break;
+    case JS_TAG_STRING:
+        {
+            JSString *p = JS_VALUE_GET_STRING(val), *p1;
+            for(; n != end; n += step) {
+                if (JS_VALUE_GET_TAG(arrp[n]) != JS_TAG_STRING)
+                    continue;
+                p1 = JS_VALUE_GET_STRING(arrp[n]);
+                if (p1 == p ||
+                    (p1->len == p->len && js_string_compare(ctx, p1, p) == 0))
+                    return n;
+            }
+        }
+        break;
+    case JS_TAG_OBJECT:
+    case JS_TAG_SYMBOL:
+        {
+            void *ptr = JS_VALUE_GET_PTR(val);
+            for(; n != end; n += step) {
+                if (JS_VALUE_GET_TAG(arrp[n]) == tag &&
+                    JS_VALUE_GET_PTR(arrp[n]) == ptr)
+                    return n;
+            }
+        }
+        break;
+    case JS_TAG_BOOL:
+    case JS_TAG_NULL:
+    case JS_TAG_UNDEFINED:
+        {
+            int v = JS_VALUE_GET_INT(val);
+            for(; n != end; n += step) {
+                if (JS_VALUE_GET_TAG(arrp[n]) == tag &&
+                    JS_VALUE_GET_INT(arrp[n]) == v)
+                    return n;
+            }
+        }
+        break;
+    default:
+        return -2;
+    }
+    return -1;
+}
+
 static JSValue js_array_includes(JSContext *ctx, JSValueConst this_val,
                                  int argc, JSValueConst *argv)
 {
@@ -38639,6 +40007,16 @@ static JSValue js_array_includes(JSContext *ctx, JSValueConst this_val,
                 goto exception;
         }
         if (js_get_fast_array(ctx, obj, &arrp, &count)) {
+            if (n < count) {
+                int64_t i = js_array_search_fast(ctx, argv[0], arrp, n,
+                                                 count, TRUE);
+                if (i >= 0) {
+                    res = TRUE;
+                    goto done;
+                }
+                if (i == -1)
+                    n = count;
+            }
             for (; n < count; n++) {
                 if (js_strict_eq2(ctx, JS_DupValue(ctx, argv[0]),
                                   JS_DupValue(ctx, arrp[n]),
@@ -38688,6 +40066,16 @@ static JSValue js_array_indexOf(JSContext *ctx, JSValueConst this_val,
                 goto exception;
         }
         if (js_get_fast_array(ctx, obj, &arrp, &count)) {
+            if (n < count) {
+                int64_t i = js_array_search_fast(ctx, argv[0], arrp, n,
+                                                 count, FALSE);
+                if (i >= 0) {
+                    res = i;
+                    goto done;
+                }
+                if (i == -1)
+                    n = count;
+            }
             for (; n < count; n++) {
                 if (js_strict_eq2(ctx, JS_DupValue(ctx, argv[0]),
                                   JS_DupValue(ctx, arrp[n]), JS_EQ_STRICT)) {
@@ -38723,6 +40111,8 @@ static JSValue js_array_lastIndexOf(JSContext *ctx, JSValueConst this_val,
     JSValue obj, val;
     int64_t len, n, res;
     int present;
+    JSValue *arrp;
+    uint32_t count;
 
     obj = JS_ToObject(ctx, this_val);
     if (js_get_length64(ctx, &len, obj))
@@ -38735,7 +40125,14 @@ static JSValue js_array_lastIndexOf(JSContext *ctx, JSValueConst this_val,
             if (JS_ToInt64Clamp(ctx, &n, argv[1], -1, len - 1, len))
                 goto exception;
         }
-        /* XXX: should special case fast arrays */
+        if (js_get_fast_array(ctx, obj, &arrp, &count) && n < count) {
+            int64_t i = js_array_search_fast(ctx, argv[0], arrp, n, -1,
+                                             FALSE);
+            if (i != -2) {
+                res = i;
+                n = -1;
+            }
+        }
         for (; n >= 0; n--) {
             present = JS_TryGetPropertyInt64(ctx, obj, n, &val);
             if (present < 0)
@@ -39418,6 +40815,158 @@ exception:
     return 0;
 }
 
+/* Zipline-patched: comparators for arrays whose elements all have the
+   same type. They order the elements exactly like js_array_cmp_generic()
+   but without converting them to strings or calling into JavaScript. */
+static inline int js_array_cmp_pos(const ValueSlot *ap, const ValueSlot *bp)
+{
+    /* make sort stable: compare array offsets */
+    return (ap->pos > bp->pos) - (ap->pos < bp->pos);
+}
+
+static int js_array_cmp_string(const void *a, const void *b, void *opaque)
+{
+    const ValueSlot *ap = a, *bp = b;
+    JSContext *ctx = opaque;
+    int cmp;
+
+    cmp = js_string_compare(ctx, JS_VALUE_GET_STRING(ap->val),
+                            JS_VALUE_GET_STRING(bp->val));
+    if (cmp != 0)
+        return cmp;
+    return js_array_cmp_pos(ap, bp);
+}
+
+static int js_u32_digits(uint32_t v)
+{
+    uint32_t p = 10;
+    int n = 1;
+
+    while (n < 10 && v >= p) {
+        n++;
+        p *= 10;
+    }
+    return n;
+}
+
+/* compare the decimal representations of two int32 values */
+static int js_array_cmp_int_string(const void *a, const void *b, void *opaque)
+{
+    const ValueSlot *ap = a, *bp = b;
+    int32_t v1 = JS_VALUE_GET_INT(ap->val), v2 = JS_VALUE_GET_INT(bp->val);
+    uint64_t u1, u2;
+    int i, n1, n2;
+
+    /* '-' sorts before the digits */
+    if ((v1 < 0) != (v2 < 0))
+        return (v1 < 0) ? -1 : 1;
+    u1 = v1 < 0 ? -(int64_t)v1 : v1;
+    u2 = v2 < 0 ? -(int64_t)v2 : v2;
+    n1 = js_u32_digits(u1);
+    n2 = js_u32_digits(u2);
+    /* pad the shorter one with zeros: a proper prefix sorts first */
+    for(i = n1; i < n2; i++)
+        u1 *= 10;
+    for(i = n2; i < n1; i++)
+        u2 *= 10;
+    if (u1 != u2)
+        return (u1 < u2) ? -1 : 1;
+    if (n1 != n2)
+        return (n1 < n2) ? -1 : 1;
+    return js_array_cmp_pos(ap, bp);
+}
+
+static inline double js_array_slot_number(const ValueSlot *p)
+{
+    if (JS_VALUE_GET_TAG(p->val) == JS_TAG_INT)
+        return JS_VALUE_GET_INT(p->val);
+    return JS_VALUE_GET_FLOAT64(p->val);
+}
+
+/* (a, b) => a - b */
+static int js_array_cmp_number(const void *a, const void *b, void *opaque)
+{
+    const ValueSlot *ap = a, *bp = b;
+    double d = js_array_slot_number(ap) - js_array_slot_number(bp);
+    int cmp = (d > 0) - (d < 0);
+
+    if (cmp != 0)
+        return cmp;
+    return js_array_cmp_pos(ap, bp);
+}
+
+/* (a, b) => b - a */
+static int js_array_cmp_number_rev(const void *a, const void *b, void *opaque)
+{
+    const ValueSlot *ap = a, *bp = b;
+    double d = js_array_slot_number(bp) - js_array_slot_number(ap);
+    int cmp = (d > 0) - (d < 0);
+
+    if (cmp != 0)
+        return cmp;
+    return js_array_cmp_pos(ap, bp);
+}
+
+/* Return 1 if 'func' is (a, b) => a - b, -1 if it is (a, b) => b - a
+   (or the equivalent function expressions), 0 otherwise. */
+static int js_get_sub_comparator(JSValueConst func)
+{
+    JSObject *p;
+    JSFunctionBytecode *b;
+    const uint8_t *pc;
+
+    if (JS_VALUE_GET_TAG(func) != JS_TAG_OBJECT)
+        return 0;
+    p = JS_VALUE_GET_OBJ(func);
+    if (p->class_id != JS_CLASS_BYTECODE_FUNCTION)
+        return 0;
+    b = p->u.func.function_bytecode;
+    if (b->func_kind != JS_FUNC_NORMAL || b->arg_count != 2 ||
+        b->byte_code_len != 4)
+        return 0;
+    pc = b->byte_code_buf;
+    if (pc[2] != OP_sub || pc[3] != OP_return)
+        return 0;
+    if (pc[0] == OP_get_arg0 && pc[1] == OP_get_arg1)
+        return 1;
+    if (pc[0] == OP_get_arg1 && pc[1] == OP_get_arg0)
+        return -1;
+    return 0;
+}
+
+typedef int js_array_cmp_f(const void *a, const void *b, void *opaque);
+
+static js_array_cmp_f *js_array_sort_specialize(JSValueConst method,
+                                                const ValueSlot *array,
+                                                size_t count)
+{
+    size_t i;
+    int tag, sub;
+
+    if (count < 2)
+        return NULL;
+    tag = JS_VALUE_GET_NORM_TAG(array[0].val);
+    if (JS_IsUndefined(method)) {
+        if (tag != JS_TAG_STRING && tag != JS_TAG_INT)
+            return NULL;
+        for(i = 1; i < count; i++) {
+            if (JS_VALUE_GET_NORM_TAG(array[i].val) != tag)
+                return NULL;
+        }
+        return (tag == JS_TAG_STRING) ? js_array_cmp_string :
+            js_array_cmp_int_string;
+    }
+    sub = js_get_sub_comparator(method);
+    if (sub == 0)
+        return NULL;
+    for(i = 0; i < count; i++) {
+        tag = JS_VALUE_GET_NORM_TAG(array[i].val);
+        if (tag != JS_TAG_INT && !JS_TAG_IS_FLOAT64(tag))
+            return NULL;
+    }
+    return (sub > 0) ? js_array_cmp_number : js_array_cmp_number_rev;
+}
+
 static JSValue js_array_sort(JSContext *ctx, JSValueConst this_val,
                              int argc, JSValueConst *argv)
 {
@@ -39427,6 +40976,10 @@ static JSValue js_array_sort(JSContext *ctx, JSValueConst this_val,
     size_t array_size = 0, pos = 0, n = 0;
     int64_t i, len, undefined_count = 0;
     int present;
+    js_array_cmp_f *cmp;
+    JSValue *arrp;
+    uint32_t count32;
+    BOOL is_fast = FALSE;
 
     if (!JS_IsUndefined(asc.method)) {
         if (check_function(ctx, asc.method))
@@ -39437,8 +40990,25 @@ static JSValue js_array_sort(JSContext *ctx, JSValueConst this_val,
     if (js_get_length64(ctx, &len, obj))
         goto exception;
 
-    /* XXX: should special case fast arrays */
-    for (i = 0; i < len; i++) {
+    if (len > 0 && js_get_fast_array(ctx, obj, &arrp, &count32) &&
+        count32 == len) {
+        /* Zipline-patched: no getter can run, copy the values directly */
+        array = js_malloc(ctx, len * sizeof(*array));
+        if (!array)
+            goto exception;
+        for (i = 0; i < len; i++) {
+            if (JS_IsUndefined(arrp[i])) {
+                undefined_count++;
+                continue;
+            }
+            array[pos].val = JS_DupValue(ctx, arrp[i]);
+            array[pos].str = NULL;
+            array[pos].pos = i;
+            pos++;
+        }
+        is_fast = TRUE;
+    }
+    for (i = is_fast ? len : 0; i < len; i++) {
         if (pos >= array_size) {
             size_t new_size, slack;
             ValueSlot *new_array;
@@ -39463,7 +41033,23 @@ static JSValue js_array_sort(JSContext *ctx, JSValueConst this_val,
         array[pos].pos = i;
         pos++;
     }
-    rqsort(array, pos, sizeof(*array), js_array_cmp_generic, &asc);
+    cmp = js_array_sort_specialize(asc.method, array, pos);
+    if (cmp) {
+        rqsort(array, pos, sizeof(*array), cmp, ctx);
+        if (is_fast) {
+            /* no JavaScript ran since the values were copied: the array
+               is unchanged and its elements are plain data properties */
+            JSObject *p = JS_VALUE_GET_OBJ(obj);
+            for (i = 0; i < pos; i++)
+                set_value(ctx, &p->u.array.u.values[i], array[i].val);
+            for (; i < len; i++)
+                set_value(ctx, &p->u.array.u.values[i], JS_UNDEFINED);
+            js_free(ctx, array);
+            return obj;
+        }
+    } else {
+        rqsort(array, pos, sizeof(*array), js_array_cmp_generic, &asc);
+    }
     if (asc.exception)
         goto exception;
 
@@ -40423,9 +42009,181 @@ static JSValue js_string_concat(JSContext *ctx, JSValueConst this_val,
     return r;
 }
 
+/* Zipline-patched: SIMD search kernels. The substring search compares
+   16 byte blocks against the first and the last char of the needle at
+   once and only verifies the candidates that match both. */
+
+static int u16_indexof_char(const uint16_t *h, int len, uint16_t c, int from)
+{
+    int i = from;
+
+#if defined(CONFIG_SIMD_SSE2)
+    const __m128i vc = _mm_set1_epi16(c);
+    for (; i + 8 <= len; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(h + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(v, vc));
+        if (mask != 0)
+            return i + (ctz32(mask) >> 1);
+    }
+#elif defined(CONFIG_SIMD_NEON)
+    const uint16x8_t vc = vdupq_n_u16(c);
+    for (; i + 8 <= len; i += 8) {
+        uint16x8_t m = vceqq_u16(vld1q_u16(h + i), vc);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(m)), 0);
+        if (mask != 0)
+            return i + (ctz64(mask) >> 3);
+    }
+#endif
+    for (; i < len; i++) {
+        if (h[i] == c)
+            return i;
+    }
+    return -1;
+}
+
+static int u32_indexof_char(const uint32_t *h, int len, uint32_t c, int from)
+{
+    int i = from;
+
+#if defined(CONFIG_SIMD_SSE2)
+    const __m128i vc = _mm_set1_epi32(c);
+    for (; i + 4 <= len; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(h + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(v, vc));
+        if (mask != 0)
+            return i + (ctz32(mask) >> 2);
+    }
+#elif defined(CONFIG_SIMD_NEON)
+    const uint32x4_t vc = vdupq_n_u32(c);
+    for (; i + 4 <= len; i += 4) {
+        uint32x4_t m = vceqq_u32(vld1q_u32(h + i), vc);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u16(vmovn_u32(m)), 0);
+        if (mask != 0)
+            return i + (ctz64(mask) >> 4);
+    }
+#endif
+    for (; i < len; i++) {
+        if (h[i] == c)
+            return i;
+    }
+    return -1;
+}
+
+/* 'len2' >= 2 */
+static int u8_indexof(const uint8_t *h, int len1, const uint8_t *n, int len2,
+                      int from)
+{
+    const uint8_t *q;
+    int i = from;
+
+#if defined(CONFIG_SIMD_SSE2)
+    const __m128i first = _mm_set1_epi8(n[0]);
+    const __m128i last = _mm_set1_epi8(n[len2 - 1]);
+    for (; i + len2 + 15 <= len1; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(h + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(h + i + len2 - 1));
+        unsigned int mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask != 0) {
+            int k = i + ctz32(mask);
+            if (!memcmp(h + k + 1, n + 1, len2 - 2))
+                return k;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(CONFIG_SIMD_NEON)
+    const uint8x16_t first = vdupq_n_u8(n[0]);
+    const uint8x16_t last = vdupq_n_u8(n[len2 - 1]);
+    for (; i + len2 + 15 <= len1; i += 16) {
+        uint8x16_t m = vandq_u8(vceqq_u8(vld1q_u8(h + i), first),
+                                vceqq_u8(vld1q_u8(h + i + len2 - 1), last));
+        /* narrow to 4 bits per byte */
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+            vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+        while (mask != 0) {
+            int k = i + (ctz64(mask) >> 2);
+            if (!memcmp(h + k + 1, n + 1, len2 - 2))
+                return k;
+            mask &= ~(uint64_t)0xf << (ctz64(mask) & ~3);
+        }
+    }
+#endif
+    while (i + len2 <= len1) {
+        q = memchr(h + i, n[0], len1 - len2 + 1 - i);
+        if (!q)
+            break;
+        i = q - h;
+        if (h[i + len2 - 1] == n[len2 - 1] &&
+            !memcmp(h + i + 1, n + 1, len2 - 2))
+            return i;
+        i++;
+    }
+    return -1;
+}
+
+/* 'len2' >= 2 */
+static int u16_indexof(const uint16_t *h, int len1, const uint16_t *n,
+                       int len2, int from)
+{
+    int i = from;
+
+#if defined(CONFIG_SIMD_SSE2)
+    const __m128i first = _mm_set1_epi16(n[0]);
+    const __m128i last = _mm_set1_epi16(n[len2 - 1]);
+    for (; i + len2 + 7 <= len1; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(h + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(h + i + len2 - 1));
+        /* 2 bits per char */
+        unsigned int mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi16(a, first), _mm_cmpeq_epi16(b, last)));
+        while (mask != 0) {
+            int k = i + (ctz32(mask) >> 1);
+            if (!memcmp(h + k + 1, n + 1, (len2 - 2) * 2))
+                return k;
+            mask &= mask - 1;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(CONFIG_SIMD_NEON)
+    const uint16x8_t first = vdupq_n_u16(n[0]);
+    const uint16x8_t last = vdupq_n_u16(n[len2 - 1]);
+    for (; i + len2 + 7 <= len1; i += 8) {
+        uint16x8_t m = vandq_u16(vceqq_u16(vld1q_u16(h + i), first),
+                                 vceqq_u16(vld1q_u16(h + i + len2 - 1), last));
+        /* 8 bits per char */
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(m)), 0);
+        while (mask != 0) {
+            int k = i + (ctz64(mask) >> 3);
+            if (!memcmp(h + k + 1, n + 1, (len2 - 2) * 2))
+                return k;
+            mask &= ~(uint64_t)0xff << (ctz64(mask) & ~7);
+        }
+    }
+#endif
+    for (; i + len2 <= len1; i++) {
+        i = u16_indexof_char(h, len1 - len2 + 1, n[0], i);
+        if (i < 0)
+            break;
+        if (h[i + len2 - 1] == n[len2 - 1] &&
+            !memcmp(h + i + 1, n + 1, (len2 - 2) * 2))
+            return i;
+    }
+    return -1;
+}
+
 static int string_cmp(JSString *p1, JSString *p2, int x1, int x2, int len)
 {
     int i, c1, c2;
+    if (p1->is_wide_char == p2->is_wide_char) {
+        /* only the sign of the result is used */
+        if (!p1->is_wide_char)
+            return memcmp(p1->u.str8 + x1, p2->u.str8 + x2, len);
+        for (i = 0; i < len; i++) {
+            if ((c1 = p1->u.str16[x1 + i]) != (c2 = p2->u.str16[x2 + i]))
+                return c1 - c2;
+        }
+        return 0;
+    }
     for (i = 0; i < len; i++) {
         if ((c1 = string_get(p1, x1 + i)) != (c2 = string_get(p2, x2 + i)))
             return c1 - c2;
@@ -40436,29 +42194,59 @@ static int string_cmp(JSString *p1, JSString *p2, int x1, int x2, int len)
 static int string_indexof_char(JSString *p, int c, int from)
 {
     /* assuming 0 <= from <= p->len */
-    int i, len = p->len;
+    int len = p->len;
+    const uint8_t *q;
     if (p->is_wide_char) {
-        for (i = from; i < len; i++) {
-            if (p->u.str16[i] == c)
-                return i;
-        }
+        if ((c & ~0xffff) == 0)
+            return u16_indexof_char(p->u.str16, len, c, from);
     } else {
-        if ((c & ~0xff) == 0) {
-            for (i = from; i < len; i++) {
-                if (p->u.str8[i] == (uint8_t)c)
-                    return i;
-            }
+        if ((c & ~0xff) == 0 && from < len) {
+            q = memchr(p->u.str8 + from, c, len - from);
+            if (q)
+                return q - p->u.str8;
         }
     }
     return -1;
 }
 
+/* maximum length of the needle converted to the width of the haystack */
+#define STRING_INDEXOF_CONV_MAX 64
+
 static int string_indexof(JSString *p1, JSString *p2, int from)
 {
     /* assuming 0 <= from <= p1->len */
     int c, i, j, len1 = p1->len, len2 = p2->len;
+    union {
+        uint8_t str8[STRING_INDEXOF_CONV_MAX];
+        uint16_t str16[STRING_INDEXOF_CONV_MAX];
+    } conv;
+
     if (len2 == 0)
         return from;
+    if (len2 == 1)
+        return string_indexof_char(p1, string_get(p2, 0), from);
+    if (len2 > len1 - from)
+        return -1;
+    if (p1->is_wide_char == p2->is_wide_char) {
+        if (!p1->is_wide_char)
+            return u8_indexof(p1->u.str8, len1, p2->u.str8, len2, from);
+        return u16_indexof(p1->u.str16, len1, p2->u.str16, len2, from);
+    }
+    if (len2 <= STRING_INDEXOF_CONV_MAX) {
+        if (p1->is_wide_char) {
+            for (i = 0; i < len2; i++)
+                conv.str16[i] = p2->u.str8[i];
+            return u16_indexof(p1->u.str16, len1, conv.str16, len2, from);
+        } else {
+            for (i = 0; i < len2; i++) {
+                c = p2->u.str16[i];
+                if (c >= 0x100)
+                    return -1;
+                conv.str8[i] = c;
+            }
+            return u8_indexof(p1->u.str8, len1, conv.str8, len2, from);
+        }
+    }
     for (i = from, c = string_get(p2, 0); i + len2 <= len1; i = j + 1) {
         j = string_indexof_char(p1, c, i);
         if (j < 0 || j + len2 > len1)
@@ -40526,7 +42314,10 @@ static JSValue js_string_indexOf(JSContext *ctx, JSValueConst this_val,
         inc = 1;
     }
     ret = -1;
-    if (len >= v_len && inc * (stop - start) >= 0) {
+    if (!lastIndexOf) {
+        if (len >= v_len && start <= stop)
+            ret = string_indexof(p, p1, start);
+    } else if (len >= v_len && inc * (stop - start) >= 0) {
         for (i = start;; i += inc) {
             if (!string_cmp(p, p1, i, 0, v_len)) {
                 ret = i;
@@ -40553,7 +42344,7 @@ static JSValue js_string_includes(JSContext *ctx, JSValueConst this_val,
                                   int argc, JSValueConst *argv, int magic)
 {
     JSValue str, v = JS_UNDEFINED;
-    int i, len, v_len, pos, start, stop, ret;
+    int len, v_len, pos, start, stop, ret;
     JSString *p;
     JSString *p1;
 
@@ -40593,13 +42384,10 @@ static JSValue js_string_includes(JSContext *ctx, JSValueConst this_val,
         start = stop = pos;
     }
     if (start >= 0 && start <= stop) {
-        for (i = start;; i++) {
-            if (!string_cmp(p, p1, i, 0, v_len)) {
-                ret = 1;
-                break;
-            }
-            if (i == stop)
-                break;
+        if (magic == 0) {
+            ret = string_indexof(p, p1, start) >= 0;
+        } else {
+            ret = !string_cmp(p, p1, start, 0, v_len);
         }
     }
  done:
@@ -41313,6 +43101,90 @@ static JSValue js_string_localeCompare(JSContext *ctx, JSValueConst this_val,
     return JS_NewInt32(ctx, cmp);
 }
 
+/* Zipline-patched: case conversion of 8-bit strings without
+   lre_case_conv(). Latin-1 letters differ from their other case by 0x20,
+   except for the few which do not have a Latin-1 upper case (U+00B5,
+   U+00DF and U+00FF). Return JS_UNDEFINED if the string contains one
+   of them. */
+static inline BOOL latin1_is_upper(uint8_t c)
+{
+    return (uint8_t)(c - 'A') < 26 || ((uint8_t)(c - 0xc0) < 0x1f && c != 0xd7);
+}
+
+static inline BOOL latin1_is_lower(uint8_t c)
+{
+    return (uint8_t)(c - 'a') < 26 || ((uint8_t)(c - 0xe0) < 0x1f && c != 0xf7);
+}
+
+static JSValue js_string_case_conv8(JSContext *ctx, JSString *p, int to_lower)
+{
+    JSString *r;
+    const uint8_t *src = p->u.str8;
+    uint8_t *dst;
+    uint32_t i, len = p->len;
+    uint8_t c;
+
+    if (!to_lower) {
+        for(i = 0; i < len; i++) {
+            c = src[i];
+            if (c == 0xb5 || c == 0xdf || c == 0xff)
+                return JS_UNDEFINED;
+        }
+    }
+    r = js_alloc_string(ctx, len, 0);
+    if (!r)
+        return JS_EXCEPTION;
+    dst = r->u.str8;
+    i = 0;
+#if defined(CONFIG_SIMD_SSE2)
+    {
+        /* unsigned 'x < n' is computed as signed '(x ^ 0x80) < (n ^ 0x80)' */
+        const __m128i sign = _mm_set1_epi8((char)0x80);
+        const __m128i ascii_first = _mm_set1_epi8(to_lower ? 'A' : 'a');
+        const __m128i latin1_first = _mm_set1_epi8((char)(to_lower ? 0xc0 : 0xe0));
+        const __m128i latin1_excl = _mm_set1_epi8((char)(to_lower ? 0xd7 : 0xf7));
+        const __m128i ascii_count = _mm_set1_epi8((char)(26 ^ 0x80));
+        const __m128i latin1_count = _mm_set1_epi8((char)(0x1f ^ 0x80));
+        const __m128i bit = _mm_set1_epi8(0x20);
+        for(; i + 16 <= len; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i m1 = _mm_cmplt_epi8(_mm_xor_si128(_mm_sub_epi8(v, ascii_first), sign),
+                                        ascii_count);
+            __m128i m2 = _mm_cmplt_epi8(_mm_xor_si128(_mm_sub_epi8(v, latin1_first), sign),
+                                        latin1_count);
+            m2 = _mm_andnot_si128(_mm_cmpeq_epi8(v, latin1_excl), m2);
+            v = _mm_xor_si128(v, _mm_and_si128(_mm_or_si128(m1, m2), bit));
+            _mm_storeu_si128((__m128i *)(dst + i), v);
+        }
+    }
+#elif defined(CONFIG_SIMD_NEON)
+    {
+        const uint8x16_t ascii_first = vdupq_n_u8(to_lower ? 'A' : 'a');
+        const uint8x16_t latin1_first = vdupq_n_u8(to_lower ? 0xc0 : 0xe0);
+        const uint8x16_t latin1_excl = vdupq_n_u8(to_lower ? 0xd7 : 0xf7);
+        const uint8x16_t ascii_count = vdupq_n_u8(26);
+        const uint8x16_t latin1_count = vdupq_n_u8(0x1f);
+        const uint8x16_t bit = vdupq_n_u8(0x20);
+        for(; i + 16 <= len; i += 16) {
+            uint8x16_t v = vld1q_u8(src + i);
+            uint8x16_t m1 = vcltq_u8(vsubq_u8(v, ascii_first), ascii_count);
+            uint8x16_t m2 = vcltq_u8(vsubq_u8(v, latin1_first), latin1_count);
+            m2 = vbicq_u8(m2, vceqq_u8(v, latin1_excl));
+            v = veorq_u8(v, vandq_u8(vorrq_u8(m1, m2), bit));
+            vst1q_u8(dst + i, v);
+        }
+    }
+#endif
+    for(; i < len; i++) {
+        c = src[i];
+        if (to_lower ? latin1_is_upper(c) : latin1_is_lower(c))
+            c ^= 0x20;
+        dst[i] = c;
+    }
+    dst[len] = '\0';
+    return JS_MKPTR(JS_TAG_STRING, r);
+}
+
 static JSValue js_string_toLowerCase(JSContext *ctx, JSValueConst this_val,
                                      int argc, JSValueConst *argv, int to_lower)
 {
@@ -41328,6 +43200,13 @@ static JSValue js_string_toLowerCase(JSContext *ctx, JSValueConst this_val,
     p = JS_VALUE_GET_STRING(val);
     if (p->len == 0)
         return val;
+    if (!p->is_wide_char) {
+        JSValue ret = js_string_case_conv8(ctx, p, to_lower);
+        if (!JS_IsUndefined(ret)) {
+            JS_FreeValue(ctx, val);
+            return ret;
+        }
+    }
     if (string_buffer_init(ctx, b, p->len))
         goto fail;
     for(i = 0; i < p->len;) {
@@ -41398,6 +43277,27 @@ static JSValue JS_NewUTF32String(JSContext *ctx, const uint32_t *buf, int len)
     return JS_EXCEPTION;
 }
 
+/* return TRUE if all the chars of 'p' are < 'bound' */
+static BOOL string_is_below(const JSString *p, uint32_t bound)
+{
+    uint32_t i;
+
+    if (!p->is_wide_char) {
+        if (bound > 0xff)
+            return TRUE;
+        for(i = 0; i < p->len; i++) {
+            if (p->u.str8[i] >= bound)
+                return FALSE;
+        }
+    } else {
+        for(i = 0; i < p->len; i++) {
+            if (p->u.str16[i] >= bound)
+                return FALSE;
+        }
+    }
+    return TRUE;
+}
+
 static JSValue js_string_normalize(JSContext *ctx, JSValueConst this_val,
                                    int argc, JSValueConst *argv)
 {
@@ -41411,10 +43311,7 @@ static JSValue js_string_normalize(JSContext *ctx, JSValueConst this_val,
     val = JS_ToStringCheckObject(ctx, this_val);
     if (JS_IsException(val))
         return val;
-    buf_len = JS_ToUTF32String(ctx, &buf, val);
-    JS_FreeValue(ctx, val);
-    if (buf_len < 0)
-        return JS_EXCEPTION;
+    buf = NULL;
 
     if (argc == 0 || JS_IsUndefined(argv[0])) {
         n_type = UNICODE_NFC;
@@ -41440,12 +43337,24 @@ static JSValue js_string_normalize(JSContext *ctx, JSValueConst this_val,
             JS_FreeCString(ctx, form);
             JS_ThrowRangeError(ctx, "bad normalization form");
         fail1:
-            js_free(ctx, buf);
+            JS_FreeValue(ctx, val);
             return JS_EXCEPTION;
         }
         JS_FreeCString(ctx, form);
     }
 
+    /* Zipline-patched: quick check. No char below these bounds is
+       changed by the normalization nor combines with its neighbours. */
+    if (string_is_below(JS_VALUE_GET_STRING(val),
+                        n_type == UNICODE_NFC ? 0x300 :
+                        n_type == UNICODE_NFD ? 0xc0 : 0xa0))
+        return val;
+
+    buf_len = JS_ToUTF32String(ctx, &buf, val);
+    JS_FreeValue(ctx, val);
+    if (buf_len < 0)
+        return JS_EXCEPTION;
+
     out_len = unicode_normalize(&out_buf, buf, buf_len, n_type,
                                 ctx->rt, (DynBufReallocFunc *)js_realloc_rt);
     js_free(ctx, buf);
@@ -42078,10 +43987,41 @@ static void js_regexp_finalizer(JSRuntime *rt, JSValue val)
     JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_STRING, re->pattern));
 }
 
+/* Return the cache entry of 'pattern' compiled with 're_flags' and set
+   '*pfound' to TRUE. If it is not cached, return the entry to replace
+   and set '*pfound' to FALSE. */
+static JSRegExpCacheEntry *js_regexp_cache_find(JSRuntime *rt, JSString *pattern,
+                                                int re_flags, uint32_t hash,
+                                                BOOL *pfound)
+{
+    JSRegExpCacheEntry *e, *lru;
+    int i;
+
+    *pfound = FALSE;
+    lru = &rt->regexp_cache[0];
+    for(i = 0; i < JS_REGEXP_CACHE_SIZE; i++) {
+        e = &rt->regexp_cache[i];
+        if (!e->pattern) {
+            lru = e;
+            continue;
+        }
+        if (e->hash == hash && e->re_flags == re_flags &&
+            e->pattern->len == pattern->len &&
+            js_string_memcmp(e->pattern, pattern, pattern->len) == 0) {
+            *pfound = TRUE;
+            return e;
+        }
+        if (lru->pattern && e->last_used < lru->last_used)
+            lru = e;
+    }
+    return lru;
+}
+
 /* create a string containing the RegExp bytecode */
 static JSValue js_compile_regexp(JSContext *ctx, JSValueConst pattern,
                                  JSValueConst flags)
 {
+    JSRuntime *rt = ctx->rt;
     const char *str;
     int re_flags, mask;
     uint8_t *re_bytecode_buf;
@@ -42089,6 +44029,10 @@ static JSValue js_compile_regexp(JSContext *ctx, JSValueConst pattern,
     int re_bytecode_len;
     JSValue ret;
     char error_msg[64];
+    JSRegExpCacheEntry *e;
+    JSString *p;
+    uint32_t hash;
+    BOOL found;
 
     re_flags = 0;
     if (!JS_IsUndefined(flags)) {
@@ -42129,6 +44073,18 @@ static JSValue js_compile_regexp(JSContext *ctx, JSValueConst pattern,
         JS_FreeCString(ctx, str);
     }
 
+    e = NULL;
+    if (JS_VALUE_GET_TAG(pattern) == JS_TAG_STRING &&
+        JS_VALUE_GET_STRING(pattern)->len <= JS_REGEXP_CACHE_PATTERN_MAX) {
+        p = JS_VALUE_GET_STRING(pattern);
+        hash = hash_string(p, 0);
+        e = js_regexp_cache_find(rt, p, re_flags, hash, &found);
+        if (found) {
+            e->last_used = ++rt->regexp_cache_clock;
+            return JS_DupValue(ctx, JS_MKPTR(JS_TAG_STRING, e->bytecode));
+        }
+    }
+
     str = JS_ToCStringLen2(ctx, &len, pattern, !(re_flags & LRE_FLAG_UTF16));
     if (!str)
         return JS_EXCEPTION;
@@ -42142,6 +44098,17 @@ static JSValue js_compile_regexp(JSContext *ctx, JSValueConst pattern,
 
     ret = js_new_string8(ctx, re_bytecode_buf, re_bytecode_len);
     js_free(ctx, re_bytecode_buf);
+    if (e && !JS_IsException(ret)) {
+        if (e->pattern) {
+            JS_FreeValue(ctx, JS_MKPTR(JS_TAG_STRING, e->pattern));
+            JS_FreeValue(ctx, JS_MKPTR(JS_TAG_STRING, e->bytecode));
+        }
+        e->pattern = JS_VALUE_GET_STRING(JS_DupValue(ctx, pattern));
+        e->bytecode = JS_VALUE_GET_STRING(JS_DupValue(ctx, ret));
+        e->hash = hash;
+        e->re_flags = re_flags;
+        e->last_used = ++rt->regexp_cache_clock;
+    }
     return ret;
 }
 
@@ -43657,12 +45624,455 @@ static JSValue json_parse_value(JSParseState *s)
     return JS_EXCEPTION;
 }
 
+/* Zipline-patched: fast JSON parser. It reads the UTF-8 input directly,
+   without the JS lexer, and builds the values as it goes. It only
+   accepts strict JSON: whenever it meets something else (including a
+   syntax error) it returns JSON_FAST_BAIL and JS_ParseJSON2() starts
+   over with the general parser, which reports the errors and handles
+   the QuickJS extensions. */
+
+#define JSON_FAST_BAIL JS_UNINITIALIZED
+
+typedef struct JSONFastParser {
+    JSContext *ctx;
+    const uint8_t *p;
+    const uint8_t *end;
+} JSONFastParser;
+
+/* return the length of the prefix of [p, end) without '"', '\\',
+   control characters or non ASCII characters */
+static size_t json_scan_plain_ascii(const uint8_t *p, const uint8_t *end)
+{
+    const uint8_t *start = p;
+
+#if defined(CONFIG_SIMD_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(' ');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        /* signed compare: the bytes >= 0x80 are negative */
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                              _mm_cmpeq_epi8(v, backslash)),
+                                 _mm_cmplt_epi8(v, space));
+        int mask = _mm_movemask_epi8(m);
+        if (mask != 0)
+            return p - start + ctz32(mask);
+        p += 16;
+    }
+#elif defined(CONFIG_SIMD_NEON)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const int8x16_t space = vdupq_n_s8(' ');
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8(p);
+        uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, quote),
+                                         vceqq_u8(v, backslash)),
+                                vcltq_s8(vreinterpretq_s8_u8(v), space));
+        /* narrow to 4 bits per byte */
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+            vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+        if (mask != 0)
+            return p - start + (ctz64(mask) >> 2);
+        p += 16;
+    }
+#endif
+    while (p < end) {
+        uint8_t c = *p;
+        if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80)
+            break;
+        p++;
+    }
+    return p - start;
+}
+
+static void json_fast_skip_ws(JSONFastParser *s)
+{
+    const uint8_t *p = s->p;
+    while (p < s->end &&
+           (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+        p++;
+    s->p = p;
+}
+
+/* 's->p' is after the opening quote. Return a string, JS_EXCEPTION or
+   JSON_FAST_BAIL. */
+static JSValue json_fast_parse_string(JSONFastParser *s)
+{
+    StringBuffer b_s, *b = &b_s;
+    const uint8_t *p = s->p;
+    const uint8_t *p_next;
+    size_t len;
+    uint32_t c;
+    int i, h;
+    JSAtom atom;
+    JSValue val;
+
+    len = json_scan_plain_ascii(p, s->end);
+    if (likely(p + len < s->end && p[len] == '"')) {
+        if (len > JS_STRING_LEN_MAX)
+            return JSON_FAST_BAIL;
+        s->p = p + len + 1;
+        atom = js_intern_atom(s->ctx, p, len);
+        if (atom != JS_ATOM_NULL) {
+            val = JS_AtomToString(s->ctx, atom);
+            JS_FreeAtom(s->ctx, atom);
+            return val;
+        }
+        return js_new_string8(s->ctx, p, len);
+    }
+
+    /* escapes or non ASCII characters */
+    if (string_buffer_init(s->ctx, b, len + 16))
+        return JS_EXCEPTION;
+    for(;;) {
+        if (string_buffer_write8(b, p, len))
+            goto fail;
+        p += len;
+        if (p >= s->end)
+            goto bail;
+        c = *p;
+        if (c == '"') {
+            p++;
+            break;
+        } else if (c == '\\') {
+            if (p + 1 >= s->end)
+                goto bail;
+            c = p[1];
+            p += 2;
+            switch(c) {
+            case '"':
+            case '\\':
+            case '/':
+                break;
+            case 'b':
+                c = '\b';
+                break;
+            case 'f':
+                c = '\f';
+                break;
+            case 'n':
+                c = '\n';
+                break;
+            case 'r':
+                c = '\r';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case 'u':
+                if (s->end - p < 4)
+                    goto bail;
+                c = 0;
+                for(i = 0; i < 4; i++) {
+                    h = from_hex(p[i]);
+                    if (h < 0)
+                        goto bail;
+                    c = (c << 4) | h;
+                }
+                p += 4;
+                if (string_buffer_putc16(b, c))
+                    goto fail;
+                goto next;
+            default:
+                goto bail;
+            }
+            if (string_buffer_putc8(b, c))
+                goto fail;
+        } else if (c >= 0x80) {
+            c = unicode_from_utf8(p, s->end - p, &p_next);
+            if (c > 0x10FFFF)
+                goto bail;
+            p = p_next;
+            if (string_buffer_putc(b, c))
+                goto fail;
+        } else {
+            /* control character */
+            goto bail;
+        }
+    next:
+        len = json_scan_plain_ascii(p, s->end);
+    }
+    s->p = p;
+    return string_buffer_end(b);
+ bail:
+    string_buffer_free(b);
+    return JSON_FAST_BAIL;
+ fail:
+    string_buffer_free(b);
+    return JS_EXCEPTION;
+}
+
+static JSValue json_fast_parse_number(JSONFastParser *s)
+{
+    const uint8_t *p = s->p;
+    const uint8_t *p_start = p;
+    const char *p_end;
+    BOOL is_neg = FALSE;
+    uint32_t n;
+    int digits;
+    JSValue val;
+
+    if (*p == '-') {
+        is_neg = TRUE;
+        p++;
+    }
+    if (p >= s->end || !is_digit(*p))
+        return JSON_FAST_BAIL;
+    if (*p == '0' && p + 1 < s->end && is_digit(p[1]))
+        return JSON_FAST_BAIL; /* leading zero */
+    /* small integers */
+    n = 0;
+    digits = 0;
+    while (p < s->end && is_digit(*p) && digits < 9) {
+        n = n * 10 + (*p - '0');
+        p++;
+        digits++;
+    }
+    if (p >= s->end || (!is_digit(*p) && *p != '.' && *p != 'e' &&
+                        *p != 'E')) {
+        s->p = p;
+        if (is_neg) {
+            if (n == 0)
+                return __JS_NewFloat64(s->ctx, -0.0);
+            return JS_NewInt32(s->ctx, -(int32_t)n);
+        }
+        return JS_NewInt32(s->ctx, n);
+    }
+    /* same conversion as the general parser. The input is NUL
+       terminated. */
+    val = js_atof(s->ctx, (const char *)p_start, &p_end, 10, 0);
+    if (JS_IsException(val))
+        return val;
+    s->p = (const uint8_t *)p_end;
+    return val;
+}
+
+static JSValue json_fast_parse_value(JSONFastParser *s);
+
+static JSValue json_fast_parse_object(JSONFastParser *s)
+{
+    JSContext *ctx = s->ctx;
+    JSValue obj, key, prop_val;
+    JSObject *p;
+    JSProperty *pr;
+    JSAtom prop_name;
+    const uint8_t *q;
+    size_t len;
+
+    obj = JS_NewObject(ctx);
+    if (JS_IsException(obj))
+        return obj;
+    p = JS_VALUE_GET_OBJ(obj);
+    json_fast_skip_ws(s);
+    if (s->p < s->end && *s->p == '}') {
+        s->p++;
+        return obj;
+    }
+    for(;;) {
+        if (s->p >= s->end || *s->p != '"')
+            goto bail;
+        /* property names are usually short and plain */
+        q = s->p + 1;
+        len = json_scan_plain_ascii(q, s->end);
+        if (likely(q + len < s->end && q[len] == '"')) {
+            prop_name = js_intern_atom(ctx, q, len);
+            if (prop_name == JS_ATOM_NULL)
+                prop_name = JS_NewAtomLen(ctx, (const char *)q, len);
+            if (prop_name == JS_ATOM_NULL)
+                goto fail;
+            s->p = q + len + 1;
+        } else {
+            s->p = q;
+            key = json_fast_parse_string(s);
+            if (JS_IsException(key))
+                goto fail;
+            if (JS_IsUninitialized(key))
+                goto bail;
+            prop_name = JS_NewAtomStr(ctx, JS_VALUE_GET_STRING(key));
+            if (prop_name == JS_ATOM_NULL)
+                goto fail;
+        }
+        json_fast_skip_ws(s);
+        if (s->p >= s->end || *s->p != ':') {
+            JS_FreeAtom(ctx, prop_name);
+            goto bail;
+        }
+        s->p++;
+        prop_val = json_fast_parse_value(s);
+        if (JS_IsException(prop_val) || JS_IsUninitialized(prop_val)) {
+            JS_FreeAtom(ctx, prop_name);
+            if (JS_IsException(prop_val))
+                goto fail;
+            goto bail;
+        }
+        if (likely(!find_own_property1(p, prop_name))) {
+            pr = add_property(ctx, p, prop_name, JS_PROP_C_W_E);
+            if (!pr) {
+                JS_FreeAtom(ctx, prop_name);
+                JS_FreeValue(ctx, prop_val);
+                goto fail;
+            }
+            pr->u.value = prop_val;
+        } else if (JS_DefinePropertyValue(ctx, obj, prop_name, prop_val,
+                                          JS_PROP_C_W_E) < 0) {
+            /* duplicate name: the last one wins */
+            JS_FreeAtom(ctx, prop_name);
+            goto fail;
+        }
+        JS_FreeAtom(ctx, prop_name);
+        json_fast_skip_ws(s);
+        if (s->p >= s->end)
+            goto bail;
+        if (*s->p == '}') {
+            s->p++;
+            break;
+        }
+        if (*s->p != ',')
+            goto bail;
+        s->p++;
+        json_fast_skip_ws(s);
+    }
+    return obj;
+ bail:
+    JS_FreeValue(ctx, obj);
+    return JSON_FAST_BAIL;
+ fail:
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+}
+
+static JSValue json_fast_parse_array(JSONFastParser *s)
+{
+    JSContext *ctx = s->ctx;
+    JSValue arr, el;
+    JSObject *p;
+
+    arr = JS_NewArray(ctx);
+    if (JS_IsException(arr))
+        return arr;
+    p = JS_VALUE_GET_OBJ(arr);
+    json_fast_skip_ws(s);
+    if (s->p < s->end && *s->p == ']') {
+        s->p++;
+        return arr;
+    }
+    for(;;) {
+        el = json_fast_parse_value(s);
+        if (JS_IsException(el))
+            goto fail;
+        if (JS_IsUninitialized(el))
+            goto bail;
+        /* a new array is fast and extensible */
+        if (add_fast_array_element(ctx, p, el, 0) < 0)
+            goto fail;
+        json_fast_skip_ws(s);
+        if (s->p >= s->end)
+            goto bail;
+        if (*s->p == ']') {
+            s->p++;
+            break;
+        }
+        if (*s->p != ',')
+            goto bail;
+        s->p++;
+    }
+    return arr;
+ bail:
+    JS_FreeValue(ctx, arr);
+    return JSON_FAST_BAIL;
+ fail:
+    JS_FreeValue(ctx, arr);
+    return JS_EXCEPTION;
+}
+
+static BOOL json_fast_match(JSONFastParser *s, const char *word, size_t len)
+{
+    const uint8_t *p = s->p;
+    if (s->end - p < len || memcmp(p, word, len) != 0)
+        return FALSE;
+    p += len;
+    /* the general parser would read a longer identifier */
+    if (p < s->end && lre_js_is_ident_next(*p))
+        return FALSE;
+    s->p = p;
+    return TRUE;
+}
+
+static JSValue json_fast_parse_value(JSONFastParser *s)
+{
+    JSContext *ctx = s->ctx;
+
+    json_fast_skip_ws(s);
+    if (s->p >= s->end)
+        return JSON_FAST_BAIL;
+    switch(*s->p) {
+    case '{':
+    case '[':
+        /* the general parser reports the overflow */
+        if (js_check_stack_overflow(ctx->rt, 0))
+            return JSON_FAST_BAIL;
+        if (*s->p++ == '{')
+            return json_fast_parse_object(s);
+        return json_fast_parse_array(s);
+    case '"':
+        s->p++;
+        return json_fast_parse_string(s);
+    case '-':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+        return json_fast_parse_number(s);
+    case 't':
+        if (json_fast_match(s, "true", 4))
+            return JS_TRUE;
+        break;
+    case 'f':
+        if (json_fast_match(s, "false", 5))
+            return JS_FALSE;
+        break;
+    case 'n':
+        if (json_fast_match(s, "null", 4))
+            return JS_NULL;
+        break;
+    default:
+        break;
+    }
+    return JSON_FAST_BAIL;
+}
+
+/* 'buf' must be NUL terminated */
+static JSValue json_fast_parse(JSContext *ctx, const char *buf, size_t buf_len)
+{
+    JSONFastParser s1, *s = &s1;
+    JSValue val;
+
+    s->ctx = ctx;
+    s->p = (const uint8_t *)buf;
+    s->end = (const uint8_t *)buf + buf_len;
+    val = json_fast_parse_value(s);
+    if (JS_IsException(val) || JS_IsUninitialized(val))
+        return val;
+    json_fast_skip_ws(s);
+    if (s->p != s->end) {
+        JS_FreeValue(ctx, val);
+        return JSON_FAST_BAIL;
+    }
+    return val;
+}
+
 JSValue JS_ParseJSON2(JSContext *ctx, const char *buf, size_t buf_len,
                       const char *filename, int flags)
 {
     JSParseState s1, *s = &s1;
     JSValue val = JS_UNDEFINED;
 
+    if (!(flags & JS_PARSE_JSON_EXT)) {
+        val = json_fast_parse(ctx, buf, buf_len);
+        if (!JS_IsUninitialized(val))
+            return val;
+        val = JS_UNDEFINED;
+    }
+
     js_parse_init(ctx, s, buf, buf_len, filename);
     s->ext_json = ((flags & JS_PARSE_JSON_EXT) != 0);
     if (json_next_token(s))
@@ -44063,6 +46473,226 @@ exception:
     return -1;
 }
 
+/* Zipline-patched: fast JSON.stringify() for the values that can be
+   encoded without running any JS code: primitives, plain objects with
+   only data properties and fast arrays, when no replacer, gap or
+   toJSON() is involved. The objects are walked through their shape
+   directly. Whenever it meets something else it returns JSON_FAST_BAIL
+   and JS_JSONStringify() starts over with the general encoder. Cycles
+   are caught by the depth limit. */
+
+#define JSON_FAST_MAX_DEPTH 64
+#define JSON_FAST_MAX_SIZE_HINT (64 * 1024)
+#define JSON_FAST_BAIL_INT 1
+
+typedef struct JSONFastWriter {
+    JSContext *ctx;
+    StringBuffer *b;
+    JSObject *object_proto;
+    JSObject *array_proto; /* NULL if arrays must take the slow path */
+} JSONFastWriter;
+
+static int json_fast_quote(StringBuffer *b, const JSString *p)
+{
+    uint32_t len, c;
+    int i;
+    char buf[8];
+
+    if (string_buffer_putc8(b, '\"'))
+        return -1;
+    for(i = 0; i < p->len; ) {
+        if (!p->is_wide_char) {
+            /* copy the runs which need no escaping in one go */
+            len = json_scan_plain_ascii(p->u.str8 + i, p->u.str8 + p->len);
+            if (len != 0) {
+                if (string_buffer_write8(b, p->u.str8 + i, len))
+                    return -1;
+                i += len;
+                if (i >= p->len)
+                    break;
+            }
+            c = p->u.str8[i++];
+        } else {
+            c = string_getc(p, &i);
+        }
+        switch(c) {
+        case '\t':
+            c = 't';
+            goto quote;
+        case '\r':
+            c = 'r';
+            goto quote;
+        case '\n':
+            c = 'n';
+            goto quote;
+        case '\b':
+            c = 'b';
+            goto quote;
+        case '\f':
+            c = 'f';
+            goto quote;
+        case '\"':
+        case '\\':
+        quote:
+            if (string_buffer_putc8(b, '\\'))
+                return -1;
+            if (string_buffer_putc8(b, c))
+                return -1;
+            break;
+        default:
+            if (c < 32 || (c >= 0xd800 && c < 0xe000)) {
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                if (string_buffer_puts8(b, buf))
+                    return -1;
+            } else {
+                if (string_buffer_putc(b, c))
+                    return -1;
+            }
+            break;
+        }
+    }
+    return string_buffer_putc8(b, '\"');
+}
+
+/* Return 0 if OK, -1 if exception or JSON_FAST_BAIL_INT. 'val' must not
+   be undefined or a symbol. */
+static int json_fast_to_str(JSONFastWriter *w, JSValueConst val, int depth)
+{
+    StringBuffer *b = w->b;
+    JSObject *p;
+    JSShape *sh;
+    JSShapeProperty *prs;
+    JSAtomStruct *ap;
+    JSValueConst v;
+    char buf[JS_DTOA_BUF_SIZE];
+    uint32_t i, idx;
+    BOOL has_content;
+    int ret;
+
+    switch(JS_VALUE_GET_NORM_TAG(val)) {
+    case JS_TAG_STRING:
+        return json_fast_quote(b, JS_VALUE_GET_STRING(val));
+    case JS_TAG_INT:
+        return string_buffer_puts8(b, i64toa(buf + sizeof(buf),
+                                             JS_VALUE_GET_INT(val), 10));
+    case JS_TAG_FLOAT64:
+        if (!isfinite(JS_VALUE_GET_FLOAT64(val)))
+            return string_buffer_puts8(b, "null");
+        js_dtoa1(buf, JS_VALUE_GET_FLOAT64(val), 10, 0, JS_DTOA_VAR_FORMAT);
+        return string_buffer_puts8(b, buf);
+    case JS_TAG_BOOL:
+        return string_buffer_puts8(b, JS_VALUE_GET_BOOL(val) ? "true" : "false");
+    case JS_TAG_NULL:
+        return string_buffer_puts8(b, "null");
+    case JS_TAG_OBJECT:
+        break;
+    default:
+        return JSON_FAST_BAIL_INT;
+    }
+
+    if (depth >= JSON_FAST_MAX_DEPTH)
+        return JSON_FAST_BAIL_INT;
+    p = JS_VALUE_GET_OBJ(val);
+    sh = p->shape;
+    if (p->class_id == JS_CLASS_ARRAY) {
+        if (!p->fast_array || sh->proto != w->array_proto ||
+            JS_VALUE_GET_TAG(p->prop[0].u.value) != JS_TAG_INT ||
+            JS_VALUE_GET_INT(p->prop[0].u.value) != p->u.array.count ||
+            find_own_property1(p, JS_ATOM_toJSON))
+            return JSON_FAST_BAIL_INT;
+        if (string_buffer_putc8(b, '['))
+            return -1;
+        for(i = 0; i < p->u.array.count; i++) {
+            if (i != 0 && string_buffer_putc8(b, ','))
+                return -1;
+            v = p->u.array.u.values[i];
+            if (JS_IsUndefined(v) || JS_VALUE_GET_TAG(v) == JS_TAG_SYMBOL) {
+                ret = string_buffer_puts8(b, "null");
+            } else {
+                ret = json_fast_to_str(w, v, depth + 1);
+            }
+            if (ret)
+                return ret;
+        }
+        return string_buffer_putc8(b, ']');
+    } else if (p->class_id == JS_CLASS_OBJECT) {
+        if (sh->proto != w->object_proto && sh->proto != NULL)
+            return JSON_FAST_BAIL_INT;
+        if (string_buffer_putc8(b, '{'))
+            return -1;
+        has_content = FALSE;
+        for(i = 0, prs = get_shape_prop(sh); i < sh->prop_count; i++, prs++) {
+            if (prs->atom == JS_ATOM_NULL)
+                continue;
+            if (prs->atom == JS_ATOM_toJSON)
+                return JSON_FAST_BAIL_INT;
+            if (!(prs->flags & JS_PROP_ENUMERABLE))
+                continue;
+            /* integer keys come first in the enumeration order */
+            if (__JS_AtomIsTaggedInt(prs->atom))
+                return JSON_FAST_BAIL_INT;
+            ap = w->ctx->rt->atom_array[prs->atom];
+            if (ap->atom_type != JS_ATOM_TYPE_STRING)
+                continue;
+            if (is_num_string(&idx, ap) && idx != -1)
+                return JSON_FAST_BAIL_INT;
+            if ((prs->flags & JS_PROP_TMASK) != JS_PROP_NORMAL)
+                return JSON_FAST_BAIL_INT;
+            v = p->prop[i].u.value;
+            if (JS_IsUndefined(v) || JS_VALUE_GET_TAG(v) == JS_TAG_SYMBOL)
+                continue;
+            if (has_content && string_buffer_putc8(b, ','))
+                return -1;
+            if (json_fast_quote(b, ap))
+                return -1;
+            if (string_buffer_putc8(b, ':'))
+                return -1;
+            ret = json_fast_to_str(w, v, depth + 1);
+            if (ret)
+                return ret;
+            has_content = TRUE;
+        }
+        return string_buffer_putc8(b, '}');
+    }
+    return JSON_FAST_BAIL_INT;
+}
+
+/* Return the JSON string, JS_UNDEFINED, JS_EXCEPTION or JSON_FAST_BAIL. */
+static JSValue json_fast_stringify(JSContext *ctx, JSValueConst obj)
+{
+    StringBuffer b_s, *b = &b_s;
+    JSONFastWriter w_s, *w = &w_s;
+    JSObject *object_proto, *array_proto;
+    int ret;
+
+    if (JS_IsUndefined(obj) || JS_VALUE_GET_TAG(obj) == JS_TAG_SYMBOL)
+        return JS_UNDEFINED;
+    object_proto = JS_VALUE_GET_OBJ(ctx->class_proto[JS_CLASS_OBJECT]);
+    array_proto = JS_VALUE_GET_OBJ(ctx->class_proto[JS_CLASS_ARRAY]);
+    /* Object.prototype has an immutable prototype */
+    if (find_own_property1(object_proto, JS_ATOM_toJSON))
+        return JSON_FAST_BAIL;
+    if (array_proto->shape->proto != object_proto ||
+        find_own_property1(array_proto, JS_ATOM_toJSON))
+        array_proto = NULL;
+    w->ctx = ctx;
+    w->b = b;
+    w->object_proto = object_proto;
+    w->array_proto = array_proto;
+
+    /* start with the size of the previous result */
+    if (string_buffer_init(ctx, b, min_uint32(ctx->json_size_hint,
+                                              JSON_FAST_MAX_SIZE_HINT)))
+        return JS_EXCEPTION;
+    ret = json_fast_to_str(w, obj, 0);
+    if (ret) {
+        string_buffer_free(b);
+        return ret < 0 ? JS_EXCEPTION : JSON_FAST_BAIL;
+    }
+    ctx->json_size_hint = b->len;
+    return string_buffer_end(b);
+}
+
 JSValue JS_JSONStringify(JSContext *ctx, JSValueConst obj,
                          JSValueConst replacer, JSValueConst space0)
 {
@@ -44072,6 +46702,12 @@ JSValue JS_JSONStringify(JSContext *ctx, JSValueConst obj,
     int res;
     int64_t i, j, n;
 
+    if (!JS_IsObject(replacer) && JS_IsUndefined(space0)) {
+        ret = json_fast_stringify(ctx, obj);
+        if (!JS_IsUninitialized(ret))
+            return ret;
+    }
+
     jsc->replacer_func = JS_UNDEFINED;
     jsc->stack = JS_UNDEFINED;
     jsc->property_list = JS_UNDEFINED;
@@ -45452,15 +48088,63 @@ static const JSCFunctionListEntry js_symbol_funcs[] = {
     JS_CFUNC_DEF("keyFor", 1, js_symbol_keyFor ),
 };
 
+/* Zipline-patched: the weak references to an object are shared by
+   WeakMap/WeakSet records, FinalizationRegistry cells and WeakRef
+   objects. They are embedded in their owner, whose type is given by
+   'kind'. */
+typedef enum {
+    JS_WEAK_REF_KIND_MAP,           /* JSMapRecord.weak_ref */
+    JS_WEAK_REF_KIND_FINREC_TARGET, /* JSFinRecCell.target_ref */
+    JS_WEAK_REF_KIND_FINREC_TOKEN,  /* JSFinRecCell.token_ref */
+    JS_WEAK_REF_KIND_WEAK_REF,      /* JSWeakRefData.weak_ref */
+} JSWeakRefKindEnum;
+
+typedef struct JSWeakRefRecord {
+    struct JSWeakRefRecord *next_weak_ref;
+    JSWeakRefKindEnum kind;
+} JSWeakRefRecord;
+
+#define weak_ref_entry(wr, type, member) \
+    ((type *)((uint8_t *)(wr) - offsetof(type, member)))
+
+static void add_weak_ref(JSObject *p, JSWeakRefRecord *wr,
+                         JSWeakRefKindEnum kind)
+{
+    wr->kind = kind;
+    wr->next_weak_ref = p->first_weak_ref;
+    p->first_weak_ref = wr;
+}
+
+/* Remove the weak reference from the object weak
+   reference list. we don't use a doubly linked list to
+   save space, assuming a given object has few weak
+       references to it */
+static void delete_weak_ref(JSObject *p, JSWeakRefRecord *wr)
+{
+    JSWeakRefRecord **pwr, *wr1;
+
+    pwr = &p->first_weak_ref;
+    for(;;) {
+        wr1 = *pwr;
+        assert(wr1 != NULL);
+        if (wr1 == wr)
+            break;
+        pwr = &wr1->next_weak_ref;
+    }
+    *pwr = wr1->next_weak_ref;
+}
+
 /* Set/Map/WeakSet/WeakMap */
 
 typedef struct JSMapRecord {
     int ref_count; /* used during enumeration to avoid freeing the record */
-    BOOL empty; /* TRUE if the record is deleted */
+    BOOL empty : 8; /* TRUE if the record is deleted */
+    BOOL value_scanned : 8; /* Zipline-patched: see gc_scan_weak_maps() */
     struct JSMapState *map;
-    struct JSMapRecord *next_weak_ref;
+    JSWeakRefRecord weak_ref; /* only used if the map is weak */
     struct list_head link;
-    struct list_head hash_link;
+    struct JSMapRecord *hash_next; /* next record in the same hash bucket */
+    uint32_t hash; /* map_hash_key() of key */
     JSValue key;
     JSValue value;
 } JSMapRecord;
@@ -45469,10 +48153,11 @@ typedef struct JSMapState {
     BOOL is_weak; /* TRUE if WeakSet/WeakMap */
     struct list_head records; /* list of JSMapRecord.link */
     uint32_t record_count;
-    struct list_head *hash_table;
+    JSMapRecord **hash_table;
     uint32_t hash_size; /* must be a power of two */
     uint32_t record_count_threshold; /* count at which a hash table
                                         resize is needed */
+    struct list_head gc_link; /* Zipline-patched: in rt->gc_weak_map_list */
 } JSMapState;
 
 #define MAGIC_SET (1 << 0)
@@ -45498,10 +48183,9 @@ static JSValue js_map_constructor(JSContext *ctx, JSValueConst new_target,
     s->is_weak = is_weak;
     JS_SetOpaque(obj, s);
     s->hash_size = 1;
-    s->hash_table = js_malloc(ctx, sizeof(s->hash_table[0]) * s->hash_size);
+    s->hash_table = js_mallocz(ctx, sizeof(s->hash_table[0]) * s->hash_size);
     if (!s->hash_table)
         goto fail;
-    init_list_head(&s->hash_table[0]);
     s->record_count_threshold = 4;
 
     arr = JS_UNDEFINED;
@@ -45599,36 +48283,50 @@ static JSValueConst map_normalize_key(JSContext *ctx, JSValueConst key)
     return key;
 }
 
-/* XXX: better hash ? */
+/* Zipline-patched: int32 keys and integral float64 keys (which must
+   hash alike) are hashed without going through a double, and string
+   keys reuse the atom hash when they are atoms. */
+static inline uint32_t map_hash_int32(uint32_t v)
+{
+    v *= 0x9e3779b1;
+    return v ^ (v >> 16);
+}
+
 static uint32_t map_hash_key(JSContext *ctx, JSValueConst key)
 {
     uint32_t tag = JS_VALUE_GET_NORM_TAG(key);
     uint32_t h;
     double d;
     JSFloat64Union u;
+    JSString *p;
 
     switch(tag) {
     case JS_TAG_BOOL:
         h = JS_VALUE_GET_INT(key);
         break;
     case JS_TAG_STRING:
-        h = hash_string(JS_VALUE_GET_STRING(key), 0);
+        p = JS_VALUE_GET_STRING(key);
+        if (p->atom_type == JS_ATOM_TYPE_STRING)
+            h = p->hash;
+        else
+            h = hash_string(p, JS_ATOM_TYPE_STRING) & JS_ATOM_HASH_MASK;
         break;
     case JS_TAG_OBJECT:
     case JS_TAG_SYMBOL:
         h = (uintptr_t)JS_VALUE_GET_PTR(key) * 3163;
         break;
     case JS_TAG_INT:
-        d = JS_VALUE_GET_INT(key) * 3163;
-        goto hash_float64;
+        return map_hash_int32(JS_VALUE_GET_INT(key)) ^ JS_TAG_INT;
     case JS_TAG_FLOAT64:
         d = JS_VALUE_GET_FLOAT64(key);
+        if (d >= INT32_MIN && d <= INT32_MAX && (int32_t)d == d)
+            return map_hash_int32((int32_t)d) ^ JS_TAG_INT;
         /* normalize the NaN */
         if (isnan(d))
             d = JS_FLOAT64_NAN;
-    hash_float64:
         u.d = d;
         h = (u.u32[0] ^ u.u32[1]) * 3163;
+        h ^= h >> 16;
         break;
     default:
         h = 0; /* XXX: bignum support */
@@ -45638,27 +48336,31 @@ static uint32_t map_hash_key(JSContext *ctx, JSValueConst key)
     return h;
 }
 
-static JSMapRecord *map_find_record(JSContext *ctx, JSMapState *s,
-                                    JSValueConst key)
+static JSMapRecord *map_find_record_hash(JSContext *ctx, JSMapState *s,
+                                         JSValueConst key, uint32_t h)
 {
-    struct list_head *el;
     JSMapRecord *mr;
-    uint32_t h;
-    h = map_hash_key(ctx, key) & (s->hash_size - 1);
-    list_for_each(el, &s->hash_table[h]) {
-        mr = list_entry(el, JSMapRecord, hash_link);
-        if (js_same_value_zero(ctx, mr->key, key))
+
+    for(mr = s->hash_table[h & (s->hash_size - 1)]; mr != NULL;
+        mr = mr->hash_next) {
+        if (mr->hash == h && js_same_value_zero(ctx, mr->key, key))
             return mr;
     }
     return NULL;
 }
 
+static JSMapRecord *map_find_record(JSContext *ctx, JSMapState *s,
+                                    JSValueConst key)
+{
+    return map_find_record_hash(ctx, s, key, map_hash_key(ctx, key));
+}
+
 static void map_hash_resize(JSContext *ctx, JSMapState *s)
 {
-    uint32_t new_hash_size, i, h;
+    uint32_t new_hash_size, h;
     size_t slack;
-    struct list_head *new_hash_table, *el;
-    JSMapRecord *mr;
+    JSMapRecord **new_hash_table, *mr;
+    struct list_head *el;
 
     /* XXX: no reporting of memory allocation failure */
     if (s->hash_size == 1)
@@ -45669,16 +48371,21 @@ static void map_hash_resize(JSContext *ctx, JSMapState *s)
                                  sizeof(new_hash_table[0]) * new_hash_size, &slack);
     if (!new_hash_table)
         return;
-    new_hash_size += slack / sizeof(*new_hash_table);
-
-    for(i = 0; i < new_hash_size; i++)
-        init_list_head(&new_hash_table[i]);
+    /* keep a power of two */
+    while (slack >= sizeof(new_hash_table[0]) * new_hash_size) {
+        slack -= sizeof(new_hash_table[0]) * new_hash_size;
+        new_hash_size *= 2;
+    }
+    memset(new_hash_table, 0, sizeof(new_hash_table[0]) * new_hash_size);
 
-    list_for_each(el, &s->records) {
+    /* insert in reverse order so that the chains keep the insertion
+       order */
+    for(el = s->records.prev; el != &s->records; el = el->prev) {
         mr = list_entry(el, JSMapRecord, link);
         if (!mr->empty) {
-            h = map_hash_key(ctx, mr->key) & (new_hash_size - 1);
-            list_add_tail(&mr->hash_link, &new_hash_table[h]);
+            h = mr->hash & (new_hash_size - 1);
+            mr->hash_next = new_hash_table[h];
+            new_hash_table[h] = mr;
         }
     }
     s->hash_table = new_hash_table;
@@ -45687,10 +48394,9 @@ static void map_hash_resize(JSContext *ctx, JSMapState *s)
 }
 
 static JSMapRecord *map_add_record(JSContext *ctx, JSMapState *s,
-                                   JSValueConst key)
+                                   JSValueConst key, uint32_t h)
 {
-    uint32_t h;
-    JSMapRecord *mr;
+    JSMapRecord *mr, **pmr;
 
     mr = js_malloc(ctx, sizeof(*mr));
     if (!mr)
@@ -45698,17 +48404,19 @@ static JSMapRecord *map_add_record(JSContext *ctx, JSMapState *s,
     mr->ref_count = 1;
     mr->map = s;
     mr->empty = FALSE;
+    mr->value_scanned = FALSE;
     if (s->is_weak) {
-        JSObject *p = JS_VALUE_GET_OBJ(key);
         /* Add the weak reference */
-        mr->next_weak_ref = p->first_weak_ref;
-        p->first_weak_ref = mr;
+        add_weak_ref(JS_VALUE_GET_OBJ(key), &mr->weak_ref,
+                     JS_WEAK_REF_KIND_MAP);
     } else {
         JS_DupValue(ctx, key);
     }
     mr->key = (JSValue)key;
-    h = map_hash_key(ctx, key) & (s->hash_size - 1);
-    list_add_tail(&mr->hash_link, &s->hash_table[h]);
+    mr->hash = h;
+    pmr = &s->hash_table[h & (s->hash_size - 1)];
+    mr->hash_next = *pmr;
+    *pmr = mr;
     list_add_tail(&mr->link, &s->records);
     s->record_count++;
     if (s->record_count >= s->record_count_threshold) {
@@ -45717,34 +48425,26 @@ static JSMapRecord *map_add_record(JSContext *ctx, JSMapState *s,
     return mr;
 }
 
-/* Remove the weak reference from the object weak
-   reference list. we don't use a doubly linked list to
-   save space, assuming a given object has few weak
-       references to it */
-static void delete_weak_ref(JSRuntime *rt, JSMapRecord *mr)
+/* remove 'mr' from its hash bucket */
+static void map_hash_unlink(JSMapState *s, JSMapRecord *mr)
 {
-    JSMapRecord **pmr, *mr1;
-    JSObject *p;
+    JSMapRecord **pmr;
 
-    p = JS_VALUE_GET_OBJ(mr->key);
-    pmr = &p->first_weak_ref;
-    for(;;) {
-        mr1 = *pmr;
-        assert(mr1 != NULL);
-        if (mr1 == mr)
-            break;
-        pmr = &mr1->next_weak_ref;
+    pmr = &s->hash_table[mr->hash & (s->hash_size - 1)];
+    while (*pmr != mr) {
+        assert(*pmr != NULL);
+        pmr = &(*pmr)->hash_next;
     }
-    *pmr = mr1->next_weak_ref;
+    *pmr = mr->hash_next;
 }
 
 static void map_delete_record(JSRuntime *rt, JSMapState *s, JSMapRecord *mr)
 {
     if (mr->empty)
         return;
-    list_del(&mr->hash_link);
+    map_hash_unlink(s, mr);
     if (s->is_weak) {
-        delete_weak_ref(rt, mr);
+        delete_weak_ref(JS_VALUE_GET_OBJ(mr->key), &mr->weak_ref);
     } else {
         JS_FreeValueRT(rt, mr->key);
     }
@@ -45771,38 +48471,13 @@ static void map_decref_record(JSRuntime *rt, JSMapRecord *mr)
     }
 }
 
-static void reset_weak_ref(JSRuntime *rt, JSObject *p)
-{
-    JSMapRecord *mr, *mr_next;
-    JSMapState *s;
-    
-    /* first pass to remove the records from the WeakMap/WeakSet
-       lists */
-    for(mr = p->first_weak_ref; mr != NULL; mr = mr->next_weak_ref) {
-        s = mr->map;
-        assert(s->is_weak);
-        assert(!mr->empty); /* no iterator on WeakMap/WeakSet */
-        list_del(&mr->hash_link);
-        list_del(&mr->link);
-    }
-    
-    /* second pass to free the values to avoid modifying the weak
-       reference list while traversing it. */
-    for(mr = p->first_weak_ref; mr != NULL; mr = mr_next) {
-        mr_next = mr->next_weak_ref;
-        JS_FreeValueRT(rt, mr->value);
-        js_free_rt(rt, mr);
-    }
-
-    p->first_weak_ref = NULL; /* fail safe */
-}
-
 static JSValue js_map_set(JSContext *ctx, JSValueConst this_val,
                           int argc, JSValueConst *argv, int magic)
 {
     JSMapState *s = JS_GetOpaque2(ctx, this_val, JS_CLASS_MAP + magic);
     JSMapRecord *mr;
     JSValueConst key, value;
+    uint32_t h;
 
     if (!s)
         return JS_EXCEPTION;
@@ -45813,14 +48488,17 @@ static JSValue js_map_set(JSContext *ctx, JSValueConst this_val,
         value = JS_UNDEFINED;
     else
         value = argv[1];
-    mr = map_find_record(ctx, s, key);
+    h = map_hash_key(ctx, key);
+    mr = map_find_record_hash(ctx, s, key, h);
     if (mr) {
         JS_FreeValue(ctx, mr->value);
     } else {
-        mr = map_add_record(ctx, s, key);
+        mr = map_add_record(ctx, s, key, h);
         if (!mr)
             return JS_EXCEPTION;
     }
+    /* Zipline-patched: the key or the value may close a cycle */
+    gc_remember(ctx->rt, JS_VALUE_GET_OBJ(this_val));
     mr->value = JS_DupValue(ctx, value);
     return JS_DupValue(ctx, this_val);
 }
@@ -45961,7 +48639,7 @@ static void js_map_finalizer(JSRuntime *rt, JSValue val)
             mr = list_entry(el, JSMapRecord, link);
             if (!mr->empty) {
                 if (s->is_weak)
-                    delete_weak_ref(rt, mr);
+                    delete_weak_ref(JS_VALUE_GET_OBJ(mr->key), &mr->weak_ref);
                 else
                     JS_FreeValueRT(rt, mr->key);
                 JS_FreeValueRT(rt, mr->value);
@@ -45982,6 +48660,11 @@ static void js_map_mark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
 
     s = p->u.map_state;
     if (s) {
+        if (s->is_weak && rt->gc_scan_weak) {
+            /* the values are scanned by gc_scan_weak_maps() */
+            list_add_tail(&s->gc_link, &rt->gc_weak_map_list);
+            return;
+        }
         list_for_each(el, &s->records) {
             mr = list_entry(el, JSMapRecord, link);
             if (!s->is_weak)
@@ -45991,6 +48674,55 @@ static void js_map_mark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
     }
 }
 
+/* Zipline-patched: keep the values of the kept WeakMaps whose key is
+   kept. Called by gc_scan() once the kept objects are scanned, so a
+   key is kept if its mark was reset. Return TRUE if a value was
+   added. */
+static BOOL gc_scan_weak_maps(JSRuntime *rt)
+{
+    struct list_head *el, *el1;
+    JSMapState *s;
+    JSMapRecord *mr;
+    BOOL added = FALSE;
+
+    list_for_each(el, &rt->gc_weak_map_list) {
+        s = list_entry(el, JSMapState, gc_link);
+        list_for_each(el1, &s->records) {
+            mr = list_entry(el1, JSMapRecord, link);
+            if (!mr->empty && !mr->value_scanned &&
+                JS_VALUE_GET_OBJ(mr->key)->header.mark == 0) {
+                mr->value_scanned = TRUE;
+                if (JS_VALUE_GET_TAG(mr->value) == JS_TAG_OBJECT) {
+                    JS_MarkValue(rt, mr->value, gc_scan_incref_child);
+                    added = TRUE;
+                }
+            }
+        }
+    }
+    return added;
+}
+
+/* Zipline-patched: restore the refcount of the values whose key is
+   deleted. They are freed with their key by reset_weak_ref(). */
+static void gc_restore_weak_maps(JSRuntime *rt)
+{
+    struct list_head *el, *el1;
+    JSMapState *s;
+    JSMapRecord *mr;
+
+    list_for_each(el, &rt->gc_weak_map_list) {
+        s = list_entry(el, JSMapState, gc_link);
+        list_for_each(el1, &s->records) {
+            mr = list_entry(el1, JSMapRecord, link);
+            if (mr->value_scanned)
+                mr->value_scanned = FALSE;
+            else if (!mr->empty)
+                JS_MarkValue(rt, mr->value, gc_scan_incref_child2);
+        }
+    }
+    init_list_head(&rt->gc_weak_map_list);
+}
+
 /* Map Iterator */
 
 typedef struct JSMapIteratorData {
@@ -46231,6 +48963,428 @@ void JS_AddIntrinsicMapSet(JSContext *ctx)
     }
 }
 
+/* WeakRef */
+
+/* Zipline-patched: a WeakRef holds a weak reference to its target,
+   which is cleared when the target is freed. */
+
+typedef struct JSWeakRefData {
+    JSWeakRefRecord weak_ref;
+    JSObject *target; /* weak, NULL once collected */
+    uint64_t kept_epoch; /* rt->weakref_kept_epoch when target was last kept */
+} JSWeakRefData;
+
+/* release the targets kept by js_weakref_deref() */
+static void js_weakref_release_kept(JSRuntime *rt)
+{
+    int i, n;
+
+    n = rt->weakref_kept_count;
+    if (n == 0)
+        return;
+    rt->weakref_kept_count = 0;
+    rt->weakref_kept_epoch++;
+    for(i = 0; i < n; i++)
+        JS_FreeValueRT(rt, rt->weakref_kept[i]);
+}
+
+/* keep the target of 'wrd' alive until the engine returns to the host. A
+   WeakRef only needs to keep it once per job. */
+static int js_weakref_keep(JSContext *ctx, JSWeakRefData *wrd)
+{
+    JSRuntime *rt = ctx->rt;
+
+    if (wrd->kept_epoch == rt->weakref_kept_epoch)
+        return 0;
+    if (js_resize_array(ctx, (void **)&rt->weakref_kept, sizeof(JSValue),
+                        &rt->weakref_kept_size, rt->weakref_kept_count + 1))
+        return -1;
+    rt->weakref_kept[rt->weakref_kept_count++] =
+        JS_DupValue(ctx, JS_MKPTR(JS_TAG_OBJECT, wrd->target));
+    wrd->kept_epoch = rt->weakref_kept_epoch;
+    return 0;
+}
+
+static void js_weakref_finalizer(JSRuntime *rt, JSValue val)
+{
+    JSWeakRefData *wrd = JS_GetOpaque(val, JS_CLASS_WEAK_REF);
+
+    if (wrd) {
+        if (wrd->target)
+            delete_weak_ref(wrd->target, &wrd->weak_ref);
+        js_free_rt(rt, wrd);
+    }
+}
+
+static JSValue js_weakref_constructor(JSContext *ctx, JSValueConst new_target,
+                                      int argc, JSValueConst *argv)
+{
+    JSValueConst target = argv[0];
+    JSWeakRefData *wrd;
+    JSValue obj;
+
+    if (!JS_IsObject(target))
+        return JS_ThrowTypeError(ctx, "invalid target");
+    obj = js_create_from_ctor(ctx, new_target, JS_CLASS_WEAK_REF);
+    if (JS_IsException(obj))
+        return obj;
+    wrd = js_malloc(ctx, sizeof(*wrd));
+    if (!wrd) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    wrd->target = JS_VALUE_GET_OBJ(target);
+    wrd->kept_epoch = ctx->rt->weakref_kept_epoch - 1;
+    add_weak_ref(wrd->target, &wrd->weak_ref, JS_WEAK_REF_KIND_WEAK_REF);
+    JS_SetOpaque(obj, wrd);
+    if (js_weakref_keep(ctx, wrd)) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    return obj;
+}
+
+static JSValue js_weakref_deref(JSContext *ctx, JSValueConst this_val,
+                                int argc, JSValueConst *argv)
+{
+    JSWeakRefData *wrd = JS_GetOpaque2(ctx, this_val, JS_CLASS_WEAK_REF);
+
+    if (!wrd)
+        return JS_EXCEPTION;
+    if (!wrd->target)
+        return JS_UNDEFINED;
+    if (js_weakref_keep(ctx, wrd))
+        return JS_EXCEPTION;
+    return JS_DupValue(ctx, JS_MKPTR(JS_TAG_OBJECT, wrd->target));
+}
+
+static const JSCFunctionListEntry js_weakref_proto_funcs[] = {
+    JS_CFUNC_DEF("deref", 0, js_weakref_deref ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "WeakRef", JS_PROP_CONFIGURABLE ),
+};
+
+/* FinalizationRegistry */
+
+/* Zipline-patched: native FinalizationRegistry. Each registration is a
+   cell with weak references to its target and unregister token. When
+   the target is collected the cell moves to the cleanup list of its
+   registry. The cleanup callbacks then run in a batch once the engine
+   returns to the host, so no JavaScript runs inside the GC. */
+
+typedef struct JSFinRecCell {
+    JSWeakRefRecord target_ref;
+    JSWeakRefRecord token_ref;
+    struct JSFinalizationRegistryData *registry;
+    struct list_head link; /* in JSFinalizationRegistryData.cells or cleanup */
+    JSObject *target; /* weak, NULL once collected */
+    JSObject *token; /* weak, NULL if none */
+    JSValue held_value;
+} JSFinRecCell;
+
+typedef struct JSFinalizationRegistryData {
+    struct list_head cells; /* list of JSFinRecCell.link with a live target */
+    struct list_head cleanup; /* list of JSFinRecCell.link with a collected target */
+    struct list_head pending_link; /* in rt->finrec_pending_list if cleanup is not empty */
+    JSObject *obj; /* the registry object, not a reference */
+    JSContext *realm;
+    JSValue cleanup_callback;
+} JSFinalizationRegistryData;
+
+static void js_finrec_delete_weak_refs(JSFinRecCell *cell)
+{
+    if (cell->target) {
+        delete_weak_ref(cell->target, &cell->target_ref);
+        cell->target = NULL;
+    }
+    if (cell->token) {
+        delete_weak_ref(cell->token, &cell->token_ref);
+        cell->token = NULL;
+    }
+}
+
+static void js_finrec_free_cells(JSRuntime *rt, struct list_head *head)
+{
+    struct list_head *el, *el1;
+    JSFinRecCell *cell;
+
+    /* first pass to remove the weak references so that freeing the
+       held values cannot reach the cells */
+    list_for_each(el, head) {
+        cell = list_entry(el, JSFinRecCell, link);
+        js_finrec_delete_weak_refs(cell);
+    }
+    list_for_each_safe(el, el1, head) {
+        cell = list_entry(el, JSFinRecCell, link);
+        JS_FreeValueRT(rt, cell->held_value);
+        js_free_rt(rt, cell);
+    }
+    init_list_head(head);
+}
+
+static void js_finrec_finalizer(JSRuntime *rt, JSValue val)
+{
+    JSFinalizationRegistryData *s = JS_GetOpaque(val, JS_CLASS_FINALIZATION_REGISTRY);
+
+    if (s) {
+        /* the pending cleanups of a collected registry are dropped */
+        if (!list_empty(&s->pending_link))
+            list_del(&s->pending_link);
+        js_finrec_free_cells(rt, &s->cells);
+        js_finrec_free_cells(rt, &s->cleanup);
+        JS_FreeValueRT(rt, s->cleanup_callback);
+        JS_FreeContext(s->realm);
+        js_free_rt(rt, s);
+    }
+}
+
+static void js_finrec_mark(JSRuntime *rt, JSValueConst val,
+                           JS_MarkFunc *mark_func)
+{
+    JSFinalizationRegistryData *s = JS_GetOpaque(val, JS_CLASS_FINALIZATION_REGISTRY);
+    struct list_head *el;
+    JSFinRecCell *cell;
+
+    if (s) {
+        list_for_each(el, &s->cells) {
+            cell = list_entry(el, JSFinRecCell, link);
+            JS_MarkValue(rt, cell->held_value, mark_func);
+        }
+        list_for_each(el, &s->cleanup) {
+            cell = list_entry(el, JSFinRecCell, link);
+            JS_MarkValue(rt, cell->held_value, mark_func);
+        }
+        JS_MarkValue(rt, s->cleanup_callback, mark_func);
+        mark_func(rt, &s->realm->header);
+    }
+}
+
+/* called from reset_weak_ref() when the target of 'cell' is freed */
+static void js_finrec_target_collected(JSRuntime *rt, JSFinRecCell *cell)
+{
+    JSFinalizationRegistryData *s = cell->registry;
+
+    cell->target = NULL;
+    list_del(&cell->link);
+    list_add_tail(&cell->link, &s->cleanup);
+    if (list_empty(&s->pending_link))
+        list_add_tail(&s->pending_link, &rt->finrec_pending_list);
+}
+
+static void js_finrec_run_cleanups(JSRuntime *rt)
+{
+    JSFinalizationRegistryData *s;
+    JSFinRecCell *cell;
+    JSValue obj, held_value, ret, exception;
+    JSContext *ctx;
+
+    rt->finrec_running = TRUE;
+    /* the callbacks must not clobber the exception of the host call */
+    exception = rt->current_exception;
+    rt->current_exception = JS_NULL;
+    while (!list_empty(&rt->finrec_pending_list)) {
+        s = list_entry(rt->finrec_pending_list.next,
+                       JSFinalizationRegistryData, pending_link);
+        list_del(&s->pending_link);
+        init_list_head(&s->pending_link);
+        /* keep the registry alive while its callbacks run */
+        obj = JS_DupValueRT(rt, JS_MKPTR(JS_TAG_OBJECT, s->obj));
+        ctx = s->realm;
+        while (!list_empty(&s->cleanup)) {
+            cell = list_entry(s->cleanup.next, JSFinRecCell, link);
+            list_del(&cell->link);
+            js_finrec_delete_weak_refs(cell);
+            held_value = cell->held_value;
+            js_free_rt(rt, cell);
+            ret = JS_Call(ctx, s->cleanup_callback, JS_UNDEFINED,
+                          1, (JSValueConst *)&held_value);
+            JS_FreeValueRT(rt, held_value);
+            if (JS_IsException(ret))
+                JS_FreeValue(ctx, JS_GetException(ctx));
+            else
+                JS_FreeValue(ctx, ret);
+        }
+        JS_FreeValueRT(rt, obj);
+    }
+    rt->current_exception = exception;
+    rt->finrec_running = FALSE;
+}
+
+static JSValue js_finrec_constructor(JSContext *ctx, JSValueConst new_target,
+                                     int argc, JSValueConst *argv)
+{
+    JSValueConst cleanup_callback = argv[0];
+    JSFinalizationRegistryData *s;
+    JSValue obj;
+
+    if (!JS_IsFunction(ctx, cleanup_callback))
+        return JS_ThrowTypeError(ctx, "cleanup callback is not a function");
+    obj = js_create_from_ctor(ctx, new_target, JS_CLASS_FINALIZATION_REGISTRY);
+    if (JS_IsException(obj))
+        return obj;
+    s = js_malloc(ctx, sizeof(*s));
+    if (!s) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    init_list_head(&s->cells);
+    init_list_head(&s->cleanup);
+    init_list_head(&s->pending_link);
+    s->obj = JS_VALUE_GET_OBJ(obj);
+    s->realm = JS_DupContext(ctx);
+    s->cleanup_callback = JS_DupValue(ctx, cleanup_callback);
+    JS_SetOpaque(obj, s);
+    return obj;
+}
+
+static JSValue js_finrec_register(JSContext *ctx, JSValueConst this_val,
+                                  int argc, JSValueConst *argv)
+{
+    JSFinalizationRegistryData *s = JS_GetOpaque2(ctx, this_val, JS_CLASS_FINALIZATION_REGISTRY);
+    JSValueConst target, held_value, token;
+    JSFinRecCell *cell;
+
+    if (!s)
+        return JS_EXCEPTION;
+    target = argv[0];
+    held_value = argv[1];
+    token = argc > 2 ? argv[2] : JS_UNDEFINED;
+    if (!JS_IsObject(target))
+        return JS_ThrowTypeError(ctx, "invalid target");
+    if (js_same_value(ctx, target, held_value))
+        return JS_ThrowTypeError(ctx, "held value must not be the target");
+    if (!JS_IsObject(token) && !JS_IsUndefined(token))
+        return JS_ThrowTypeError(ctx, "invalid unregister token");
+    cell = js_malloc(ctx, sizeof(*cell));
+    if (!cell)
+        return JS_EXCEPTION;
+    cell->registry = s;
+    cell->target = JS_VALUE_GET_OBJ(target);
+    add_weak_ref(cell->target, &cell->target_ref,
+                 JS_WEAK_REF_KIND_FINREC_TARGET);
+    if (JS_IsObject(token)) {
+        cell->token = JS_VALUE_GET_OBJ(token);
+        add_weak_ref(cell->token, &cell->token_ref,
+                     JS_WEAK_REF_KIND_FINREC_TOKEN);
+    } else {
+        cell->token = NULL;
+    }
+    cell->held_value = JS_DupValue(ctx, held_value);
+    list_add_tail(&cell->link, &s->cells);
+    return JS_UNDEFINED;
+}
+
+static JSValue js_finrec_unregister(JSContext *ctx, JSValueConst this_val,
+                                    int argc, JSValueConst *argv)
+{
+    JSFinalizationRegistryData *s = JS_GetOpaque2(ctx, this_val, JS_CLASS_FINALIZATION_REGISTRY);
+    JSValueConst token = argv[0];
+    JSWeakRefRecord *wr;
+    JSFinRecCell *cell;
+    struct list_head removed;
+
+    if (!s)
+        return JS_EXCEPTION;
+    if (!JS_IsObject(token))
+        return JS_ThrowTypeError(ctx, "invalid unregister token");
+    /* the cells of this registry are found from the weak references to
+       the token */
+    init_list_head(&removed);
+    wr = JS_VALUE_GET_OBJ(token)->first_weak_ref;
+    while (wr != NULL) {
+        if (wr->kind == JS_WEAK_REF_KIND_FINREC_TOKEN) {
+            cell = weak_ref_entry(wr, JSFinRecCell, token_ref);
+            if (cell->registry == s) {
+                list_del(&cell->link);
+                js_finrec_delete_weak_refs(cell);
+                list_add_tail(&cell->link, &removed);
+                wr = JS_VALUE_GET_OBJ(token)->first_weak_ref;
+                continue;
+            }
+        }
+        wr = wr->next_weak_ref;
+    }
+    if (list_empty(&removed))
+        return JS_FALSE;
+    js_finrec_free_cells(ctx->rt, &removed);
+    return JS_TRUE;
+}
+
+static const JSCFunctionListEntry js_finrec_proto_funcs[] = {
+    JS_CFUNC_DEF("register", 2, js_finrec_register ),
+    JS_CFUNC_DEF("unregister", 1, js_finrec_unregister ),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "FinalizationRegistry", JS_PROP_CONFIGURABLE ),
+};
+
+static void reset_weak_ref(JSRuntime *rt, JSObject *p)
+{
+    JSWeakRefRecord *wr, *wr_next, *map_refs;
+    JSMapRecord *mr;
+    JSMapState *s;
+
+    /* first pass to remove the records from the WeakMap/WeakSet
+       lists, to queue the FinalizationRegistry cleanups and to clear
+       the WeakRef targets */
+    map_refs = NULL;
+    for(wr = p->first_weak_ref; wr != NULL; wr = wr_next) {
+        wr_next = wr->next_weak_ref;
+        switch(wr->kind) {
+        case JS_WEAK_REF_KIND_MAP:
+            mr = weak_ref_entry(wr, JSMapRecord, weak_ref);
+            s = mr->map;
+            assert(s->is_weak);
+            assert(!mr->empty); /* no iterator on WeakMap/WeakSet */
+            map_hash_unlink(s, mr);
+            list_del(&mr->link);
+            wr->next_weak_ref = map_refs;
+            map_refs = wr;
+            break;
+        case JS_WEAK_REF_KIND_FINREC_TARGET:
+            js_finrec_target_collected(rt, weak_ref_entry(wr, JSFinRecCell, target_ref));
+            break;
+        case JS_WEAK_REF_KIND_FINREC_TOKEN:
+            weak_ref_entry(wr, JSFinRecCell, token_ref)->token = NULL;
+            break;
+        case JS_WEAK_REF_KIND_WEAK_REF:
+            weak_ref_entry(wr, JSWeakRefData, weak_ref)->target = NULL;
+            break;
+        }
+    }
+    p->first_weak_ref = NULL; /* fail safe */
+
+    /* second pass to free the values to avoid modifying the weak
+       reference list while traversing it. Freeing a value may free a
+       registry and its cells, so only the map records are visited. */
+    for(wr = map_refs; wr != NULL; wr = wr_next) {
+        wr_next = wr->next_weak_ref;
+        mr = weak_ref_entry(wr, JSMapRecord, weak_ref);
+        JS_FreeValueRT(rt, mr->value);
+        js_free_rt(rt, mr);
+    }
+}
+
+void JS_AddIntrinsicWeakRef(JSContext *ctx)
+{
+    JSValue obj1;
+
+    ctx->class_proto[JS_CLASS_WEAK_REF] = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, ctx->class_proto[JS_CLASS_WEAK_REF],
+                               js_weakref_proto_funcs,
+                               countof(js_weakref_proto_funcs));
+    obj1 = JS_NewCFunction2(ctx, js_weakref_constructor, "WeakRef",
+                            1, JS_CFUNC_constructor, 0);
+    JS_NewGlobalCConstructor2(ctx, obj1, "WeakRef",
+                              ctx->class_proto[JS_CLASS_WEAK_REF]);
+
+    ctx->class_proto[JS_CLASS_FINALIZATION_REGISTRY] = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, ctx->class_proto[JS_CLASS_FINALIZATION_REGISTRY],
+                               js_finrec_proto_funcs,
+                               countof(js_finrec_proto_funcs));
+    obj1 = JS_NewCFunction2(ctx, js_finrec_constructor, "FinalizationRegistry",
+                            1, JS_CFUNC_constructor, 0);
+    JS_NewGlobalCConstructor2(ctx, obj1, "FinalizationRegistry",
+                              ctx->class_proto[JS_CLASS_FINALIZATION_REGISTRY]);
+}
+
 /* Generator */
 static const JSCFunctionListEntry js_generator_function_proto_funcs[] = {
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "GeneratorFunction", JS_PROP_CONFIGURABLE),
@@ -51578,6 +54732,85 @@ static JSValue js_typed_array_get_toStringTag(JSContext *ctx,
     return JS_AtomToString(ctx, ctx->rt->class_array[p->class_id].class_name);
 }
 
+static inline BOOL is_bigint_typed_array(int class_id)
+{
+#ifdef CONFIG_BIGNUM
+    return class_id == JS_CLASS_BIG_INT64_ARRAY ||
+        class_id == JS_CLASS_BIG_UINT64_ARRAY;
+#else
+    return FALSE;
+#endif
+}
+
+/* Zipline-patched: convert 'len' elements of type 'src_class_id' to the
+   type of the typed array 'p', starting at element 'offset'. Same
+   result as getting and setting each element, without the JSValues.
+   BigInt arrays are not supported. */
+static void js_typed_array_convert(JSObject *p, uint32_t offset,
+                                   const uint8_t *src, int src_class_id,
+                                   uint32_t len)
+{
+    uint32_t i;
+    double d;
+
+    for(i = 0; i < len; i++) {
+        switch(src_class_id) {
+        case JS_CLASS_INT8_ARRAY:
+            d = ((const int8_t *)src)[i];
+            break;
+        case JS_CLASS_UINT8C_ARRAY:
+        case JS_CLASS_UINT8_ARRAY:
+            d = src[i];
+            break;
+        case JS_CLASS_INT16_ARRAY:
+            d = ((const int16_t *)src)[i];
+            break;
+        case JS_CLASS_UINT16_ARRAY:
+            d = ((const uint16_t *)src)[i];
+            break;
+        case JS_CLASS_INT32_ARRAY:
+            d = ((const int32_t *)src)[i];
+            break;
+        case JS_CLASS_UINT32_ARRAY:
+            d = ((const uint32_t *)src)[i];
+            break;
+        case JS_CLASS_FLOAT32_ARRAY:
+            d = ((const float *)src)[i];
+            break;
+        case JS_CLASS_FLOAT64_ARRAY:
+            d = ((const double *)src)[i];
+            break;
+        default:
+            abort();
+        }
+        switch(p->class_id) {
+        case JS_CLASS_UINT8C_ARRAY:
+            p->u.array.u.uint8_ptr[offset + i] = js_float64_to_uint8_clamp(d);
+            break;
+        case JS_CLASS_INT8_ARRAY:
+        case JS_CLASS_UINT8_ARRAY:
+            p->u.array.u.uint8_ptr[offset + i] = js_float64_to_int32(d);
+            break;
+        case JS_CLASS_INT16_ARRAY:
+        case JS_CLASS_UINT16_ARRAY:
+            p->u.array.u.uint16_ptr[offset + i] = js_float64_to_int32(d);
+            break;
+        case JS_CLASS_INT32_ARRAY:
+        case JS_CLASS_UINT32_ARRAY:
+            p->u.array.u.uint32_ptr[offset + i] = js_float64_to_int32(d);
+            break;
+        case JS_CLASS_FLOAT32_ARRAY:
+            p->u.array.u.float_ptr[offset + i] = d;
+            break;
+        case JS_CLASS_FLOAT64_ARRAY:
+            p->u.array.u.double_ptr[offset + i] = d;
+            break;
+        default:
+            abort();
+        }
+    }
+}
+
 static JSValue js_typed_array_set_internal(JSContext *ctx,
                                            JSValueConst dst,
                                            JSValueConst src,
@@ -51627,9 +54860,24 @@ static JSValue js_typed_array_set_internal(JSContext *ctx,
                     src_abuf->data + src_ta->offset, src_len << shift);
             goto done;
         }
-        if (dest_abuf->data == src_abuf->data) {
-            /* copying between the same buffer using different types of mappings
-               would require a temporary buffer */
+        if (!is_bigint_typed_array(p->class_id) &&
+            !is_bigint_typed_array(src_p->class_id)) {
+            const uint8_t *src_data = src_abuf->data + src_ta->offset;
+            uint8_t *tmp = NULL;
+            if (dest_abuf->data == src_abuf->data && src_len > 0) {
+                /* copying between the same buffer using different types
+                   of mappings requires a temporary buffer */
+                size_t size = src_len << typed_array_size_log2(src_p->class_id);
+                tmp = js_malloc(ctx, size);
+                if (!tmp)
+                    goto fail;
+                memcpy(tmp, src_data, size);
+                src_data = tmp;
+            }
+            js_typed_array_convert(p, offset, src_data, src_p->class_id,
+                                   src_len);
+            js_free(ctx, tmp);
+            goto done;
         }
         /* otherwise, default behavior is slow but correct */
     } else {
@@ -51985,31 +55233,37 @@ static JSValue js_typed_array_fill(JSContext *ctx, JSValueConst this_val,
     if (typed_array_is_detached(ctx, p))
         return JS_ThrowTypeErrorDetachedArrayBuffer(ctx);
     
+    if (k >= final)
+        return JS_DupValue(ctx, this_val);
     shift = typed_array_size_log2(p->class_id);
     switch(shift) {
     case 0:
-        if (k < final) {
-            memset(p->u.array.u.uint8_ptr + k, v64, final - k);
-        }
+        memset(p->u.array.u.uint8_ptr + k, v64, final - k);
         break;
     case 1:
-        for(; k < final; k++) {
-            p->u.array.u.uint16_ptr[k] = v64;
-        }
+        p->u.array.u.uint16_ptr[k] = v64;
         break;
     case 2:
-        for(; k < final; k++) {
-            p->u.array.u.uint32_ptr[k] = v64;
-        }
+        p->u.array.u.uint32_ptr[k] = v64;
         break;
     case 3:
-        for(; k < final; k++) {
-            p->u.array.u.uint64_ptr[k] = v64;
-        }
+        p->u.array.u.uint64_ptr[k] = v64;
         break;
     default:
         abort();
     }
+    if (shift > 0) {
+        /* Zipline-patched: replicate the first element with memcpy()
+           calls of doubling size instead of storing each element */
+        uint8_t *dst = p->u.array.u.uint8_ptr + ((size_t)k << shift);
+        size_t size = (size_t)(final - k) << shift;
+        size_t n = (size_t)1 << shift, c;
+        while (n < size) {
+            c = (n < size - n) ? n : size - n;
+            memcpy(dst + n, dst, c);
+            n += c;
+        }
+    }
     return JS_DupValue(ctx, this_val);
 }
 
@@ -52199,6 +55453,10 @@ static JSValue js_typed_array_indexOf(JSContext *ctx, JSValueConst this_val,
         scan16:
             pv = p->u.array.u.uint16_ptr;
             v = v64;
+            if (inc > 0) {
+                res = u16_indexof_char(pv, len, v, k);
+                break;
+            }
             for (; k != stop; k += inc) {
                 if (pv[k] == v) {
                     res = k;
@@ -52218,6 +55476,10 @@ static JSValue js_typed_array_indexOf(JSContext *ctx, JSValueConst this_val,
         scan32:
             pv = p->u.array.u.uint32_ptr;
             v = v64;
+            if (inc > 0) {
+                res = u32_indexof_char(pv, len, v, k);
+                break;
+            }
             for (; k != stop; k += inc) {
                 if (pv[k] == v) {
                     res = k;
@@ -52242,6 +55504,16 @@ static JSValue js_typed_array_indexOf(JSContext *ctx, JSValueConst this_val,
             }
         } else if ((f = (float)d) == d) {
             const float *pv = p->u.array.u.float_ptr;
+            if (inc > 0 && f != 0) {
+                /* except for zeros, equal floats have the same bits */
+                union {
+                    float f;
+                    uint32_t u32;
+                } u;
+                u.f = f;
+                res = u32_indexof_char(p->u.array.u.uint32_ptr, len, u.u32, k);
+                break;
+            }
             for (; k != stop; k += inc) {
                 if (pv[k] == f) {
                     res = k;
@@ -345,6 +345,34 @@ void JS_SetRuntimeOpaque(JSRuntime *rt, void *opaque);
 typedef void JS_MarkFunc(JSRuntime *rt, JSGCObjectHeader *gp);
 void JS_MarkValue(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func);
 void JS_RunGC(JSRuntime *rt);
+/* Zipline-patched: generational cycle collection */
+void JS_SetGenerationalGC(JSRuntime *rt, JS_BOOL enabled);
+void JS_RunMinorGC(JSRuntime *rt);
+/* Zipline-patched: full cycle collections deferred to JS_RunGCStep() */
+void JS_SetIncrementalGC(JSRuntime *rt, JS_BOOL enabled);
+JS_BOOL JS_RunGCStep(JSRuntime *rt, int64_t budget_ns);
+/* Zipline-patched: threshold policies for automatic GC */
+#define JS_GC_POLICY_FIXED        0 /* 1.5 times the heap after the last GC */
+#define JS_GC_POLICY_ADAPTIVE     1 /* grows when collections reclaim little or pause long */
+#define JS_GC_POLICY_MEMORY_LIMIT 2 /* targets a ceiling below the memory limit */
+void JS_SetGCPolicy(JSRuntime *rt, int policy);
+/* Zipline-patched: always-on GC and allocation counters */
+typedef struct JSGCStats {
+    int64_t full_gc_count;
+    int64_t minor_gc_count;
+    int64_t pause_total_ns; /* over all collections */
+    int64_t pause_max_ns;
+    int64_t full_gc_freed_count; /* objects and functions freed */
+    int64_t minor_gc_freed_count;
+    int64_t alloc_count; /* since the runtime was created */
+    int64_t alloc_size;
+} JSGCStats;
+void JS_GetGCStats(JSRuntime *rt, JSGCStats *s);
+/* called after each collection */
+typedef void JSGCCallback(JSRuntime *rt, void *opaque);
+void JS_SetGCCallback(JSRuntime *rt, JSGCCallback *cb, void *opaque);
+/* Zipline-patched: free large blocks on a background thread */
+void JS_SetDeferredFree(JSRuntime *rt, JS_BOOL enabled);
 JS_BOOL JS_IsLiveObject(JSRuntime *rt, JSValueConst obj);
 
 JSContext *JS_NewContext(JSRuntime *rt);
@@ -370,6 +398,7 @@ void JS_AddIntrinsicProxy(JSContext *ctx);
 void JS_AddIntrinsicMapSet(JSContext *ctx);
 void JS_AddIntrinsicTypedArrays(JSContext *ctx);
 void JS_AddIntrinsicPromise(JSContext *ctx);
+void JS_AddIntrinsicWeakRef(JSContext *ctx);
 void JS_AddIntrinsicBigInt(JSContext *ctx);
 void JS_AddIntrinsicBigFloat(JSContext *ctx);
 void JS_AddIntrinsicBigDecimal(JSContext *ctx);
@@ -693,6 +722,9 @@ int JS_ToBigInt64(JSContext *ctx, int64_t *pres, JSValueConst val);
 int JS_ToInt64Ext(JSContext *ctx, int64_t *pres, JSValueConst val);
 
 JSValue JS_NewStringLen(JSContext *ctx, const char *str1, size_t len1);
+/* Zipline-patched: same as JS_NewStringLen() but short ASCII strings
+   which recur are shared through a per-runtime cache */
+JSValue JS_NewStringInterned(JSContext *ctx, const char *str1, size_t len1);
 JSValue JS_NewString(JSContext *ctx, const char *str);
 JSValue JS_NewAtomString(JSContext *ctx, const char *str);
 JSValue JS_ToString(JSContext *ctx, JSValueConst val);
@@ -873,6 +905,9 @@ int JS_EnqueueJob(JSContext *ctx, JSJobFunc *job_func, int argc, JSValueConst *a
 
 JS_BOOL JS_IsJobPending(JSRuntime *rt);
 int JS_ExecutePendingJob(JSRuntime *rt, JSContext **pctx);
+/* Zipline-patched: drain the job queue in one call */
+int JS_ExecutePendingJobs(JSRuntime *rt, int max_jobs, int64_t budget_ns,
+                          JSContext **pctx);
 
 /* Object Writer/Reader (currently only used to handle precompiled code) */
 #define JS_WRITE_OBJ_BYTECODE  (1 << 0) /* allow function/module */
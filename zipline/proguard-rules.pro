@@ -2,7 +2,9 @@
 
 -keep,allowoptimization class app.cash.zipline.QuickJsException { * ; }
 -keep,allowoptimization interface app.cash.zipline.InterruptHandler { * ; }
+-keep,allowoptimization interface app.cash.zipline.GcListener { * ; }
 -keep,allowoptimization interface app.cash.zipline.internal.bridge.CallChannel { * ; }
+-keep,allowoptimization interface app.cash.zipline.internal.TimerScheduler { * ; }
 
 
 ### KOTLINX.SERIALIZATION
@@ -59,6 +59,17 @@ abstract class EventListener {
   open fun serviceLeaked(zipline: Zipline, name: String) {
   }
 
+  /**
+   * Invoked after each QuickJS garbage collection. Use this to monitor GC pressure; unlike
+   * [QuickJs.memoryUsage], [stats] is cheap to produce.
+   *
+   * This is called on the thread that triggered the collection, which may be in the middle of
+   * executing JavaScript. Implementations must not call into [zipline].
+   */
+  @EngineApi
+  open fun gcCompleted(zipline: Zipline, stats: GcStats) {
+  }
+
   /**
    * Invoked when an application load starts.
    *
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2022 Block, Inc.
+ * Copyright (C) 2026 Block, Inc.
  *
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -13,19 +13,13 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-#ifndef QUICKJS_ANDROID_FINALIZATIONREGISTRY_H
-#define QUICKJS_ANDROID_FINALIZATIONREGISTRY_H
+package app.cash.zipline
 
-#include "../quickjs/quickjs.h"
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-int installFinalizationRegistry(JSContext *jsContext, JSContext *jsContextForCompiling);
-
-#ifdef __cplusplus
-} /* extern "C" { */
-#endif
-
-#endif //QUICKJS_ANDROID_FINALIZATIONREGISTRY_H
+@EngineApi
+fun interface GcListener {
+  /**
+   * This function is called after each garbage collection, on the thread that triggered it. That
+   * may be in the middle of executing JavaScript, so this must not call into the [QuickJs].
+   */
+  fun gcCompleted(stats: GcStats)
+}
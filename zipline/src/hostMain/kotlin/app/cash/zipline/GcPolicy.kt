@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2026 Block, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package app.cash.zipline
+
+/**
+ * How QuickJS picks the heap size that triggers its next automatic garbage collection.
+ *
+ * [QuickJs.gcThreshold] sets the threshold for the first collection. After each automatic
+ * collection the policy computes the next one.
+ */
+@EngineApi
+enum class GcPolicy {
+  /** The next collection runs when the heap is 1.5x its size after the last collection. */
+  Fixed,
+
+  /**
+   * Like [Fixed], but the threshold grows (up to 5x the surviving heap) while collections reclaim
+   * less than 10% of the heap or pause for more than 10% of the time since the previous one. It
+   * shrinks back when they reclaim more than half of the heap.
+   */
+  Adaptive,
+
+  /**
+   * Lets garbage accumulate until the heap reaches 3/4 of [QuickJs.memoryLimit]. Beyond that
+   * ceiling a collection runs each time half of the remaining headroom is used. Behaves like
+   * [Fixed] if there is no memory limit.
+   */
+  MemoryLimit,
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2026 Block, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package app.cash.zipline
+
+/**
+ * Counters of QuickJS garbage collection and allocation. Unlike [MemoryUsage] these are maintained
+ * as the engine runs, so reading them doesn't walk the heap.
+ */
+@EngineApi
+data class GcStats(
+  /** Full collections since the engine was created. This includes calls to [QuickJs.gc]. */
+  val fullGcCount: Long,
+
+  /** Collections of only the young generation. These only happen with [QuickJs.generationalGc]. */
+  val minorGcCount: Long,
+
+  /** Time spent collecting garbage, summed over all collections. */
+  val pauseTotalNanos: Long,
+
+  /** Duration of the longest single collection. */
+  val pauseMaxNanos: Long,
+
+  /** Objects and functions freed by full collections. */
+  val fullGcObjectsFreed: Long,
+
+  /** Objects and functions freed by minor collections. */
+  val minorGcObjectsFreed: Long,
+
+  /**
+   * Allocations since the engine was created. Reallocations count as allocations of their new
+   * size. Subtract an earlier [GcStats] to get the allocations in between.
+   */
+  val allocatedCount: Long,
+  val allocatedSize: Long,
+)
@@ -15,6 +15,7 @@
  */
 package app.cash.zipline
 
+import app.cash.zipline.internal.TimerScheduler
 import app.cash.zipline.internal.bridge.CallChannel
 
 /**
@@ -46,12 +47,45 @@ expect class QuickJs : AutoCloseable {
   /** Memory usage statistics for the JavaScript engine. */
   val memoryUsage: MemoryUsage
 
+  /**
+   * Garbage collection statistics for the JavaScript engine. This is cheap enough to read
+   * frequently. All counters are cumulative; subtract an earlier value to measure an interval.
+   */
+  val gcStats: GcStats
+
+  /** Notified after each garbage collection. Default is null. */
+  var gcListener: GcListener?
+
   /** Default is -1. Use -1 for no limit. */
   var memoryLimit: Long
 
   /** Default is 256 KiB. Use -1 to disable automatic GC. */
   var gcThreshold: Long
 
+  /** Default is [GcPolicy.Fixed]. */
+  var gcPolicy: GcPolicy
+
+  /**
+   * Default is false. When true, automatic GC only looks for cycles among objects that were
+   * allocated or mutated since the previous collection. Every few collections it scans the whole
+   * heap, which is what [gc] always does.
+   */
+  var generationalGc: Boolean
+
+  /**
+   * Default is false. When true, crossing [gcThreshold] doesn't run a full collection on the
+   * calling thread. Instead that work is left pending for [gcStep]. (If the heap doubles while a
+   * collection is pending, it runs anyway.)
+   */
+  var incrementalGc: Boolean
+
+  /**
+   * Default is false. When true, large blocks of memory released by JavaScript (big strings,
+   * arrays, and array buffers) are returned to the system allocator on a background thread. This
+   * keeps the calling thread's pauses short when a large object graph is freed.
+   */
+  var deferredFree: Boolean
+
   /** Default is 512 KiB. Use 0 to disable the maximum stack size check. */
   var maxStackSize: Long
 
@@ -78,8 +112,28 @@ expect class QuickJs : AutoCloseable {
    */
   fun execute(bytecode: ByteArray): Any?
 
+  /**
+   * Runs pending jobs, like promise reactions, until none remain, [maxJobs] jobs have run, or
+   * [budgetNanos] have elapsed. A limit of 0 or less means no limit. This is much cheaper than
+   * running jobs one call at a time.
+   *
+   * Returns true if jobs remain pending.
+   *
+   * @throws QuickJsException if a job throws.
+   */
+  fun executePendingJobs(maxJobs: Int, budgetNanos: Long): Boolean
+
   internal fun initOutboundChannel(outboundChannel: CallChannel)
 
+  /** Installs native `setTimeout()` and `clearTimeout()` functions for the guest to use. */
+  internal fun initTimers(timerScheduler: TimerScheduler)
+
+  /** Timers registered after this call start a new bucket. */
+  internal fun startTimers(bucketId: Int)
+
+  /** Runs the timers of [bucketId] in the order they were registered. */
+  internal fun runTimers(bucketId: Int)
+
   internal fun getInboundChannel(): CallChannel
 
   /**
@@ -88,5 +142,17 @@ expect class QuickJs : AutoCloseable {
    */
   fun gc()
 
+  /**
+   * Performs pending garbage collection work if it is expected to fit within [budgetNanos]. Use
+   * this with [incrementalGc] to collect garbage from an idle handler.
+   *
+   * A full collection can't be split across calls. It runs to completion if the previous one took
+   * no longer than [budgetNanos], and is skipped otherwise. The budget only decides whether to
+   * start; it doesn't bound how long this call takes.
+   *
+   * Returns true if work remains pending.
+   */
+  fun gcStep(budgetNanos: Long): Boolean
+
   override fun close()
 }
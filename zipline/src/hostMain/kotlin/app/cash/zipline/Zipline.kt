@@ -93,7 +93,14 @@ actual class Zipline private constructor(
     // Eagerly publish the channel so the guest can call us.
     quickJs.initOutboundChannel(endpoint.inboundChannel)
 
-    val eventLoop = CoroutineEventLoop(dispatcher, scope, guest)
+    if (eventListener !== EventListener.NONE) {
+      quickJs.gcListener = GcListener { stats ->
+        eventListener.gcCompleted(this, stats)
+      }
+    }
+
+    val eventLoop = CoroutineEventLoop(dispatcher, scope, guest, quickJs)
+    quickJs.initTimers(eventLoop)
 
     endpoint.bind<HostService>(
       name = ZIPLINE_HOST_NAME,
@@ -15,6 +15,7 @@
  */
 package app.cash.zipline.internal
 
+import app.cash.zipline.QuickJs
 import app.cash.zipline.internal.bridge.theOnlyCancellationException
 import kotlinx.coroutines.CoroutineDispatcher
 import kotlinx.coroutines.CoroutineScope
@@ -23,20 +24,29 @@ import kotlinx.coroutines.Job
 import kotlinx.coroutines.Runnable
 import kotlinx.coroutines.delay
 import kotlinx.coroutines.ensureActive
+import kotlinx.coroutines.isActive
 import kotlinx.coroutines.launch
 
 /**
  * We implement scheduled work with raw calls to [CoroutineDispatcher.dispatch] because it prevents
  * recursion. Otherwise, it's easy to unintentionally have `setTimeout(0, ...)` calls that execute
  * immediately, eventually exhausting stack space and crashing the process.
+ *
+ * Guests that use the native `setTimeout()` share one coroutine for each bucket of timers; see
+ * [TimerScheduler]. Older guests call [setTimeout] across the bridge and get one coroutine each.
  */
 internal class CoroutineEventLoop(
   private val dispatcher: CoroutineDispatcher,
   private val scope: CoroutineScope,
   private val guestService: GuestService,
-) {
+  private val quickJs: QuickJs,
+) : TimerScheduler {
   private val jobs = mutableMapOf<Int, DelayedJob>()
 
+  override fun scheduleTimers(bucketId: Int, delayMillis: Int) {
+    dispatcher.dispatch(scope.coroutineContext, TimerBucket(bucketId, delayMillis))
+  }
+
   fun setTimeout(timeoutId: Int, delayMillis: Int) {
     val job = DelayedJob(timeoutId, delayMillis)
     jobs[timeoutId] = job
@@ -47,6 +57,21 @@ internal class CoroutineEventLoop(
     jobs.remove(timeoutId)?.cancel()
   }
 
+  private inner class TimerBucket(
+    val bucketId: Int,
+    val delayMillis: Int,
+  ) : Runnable {
+    override fun run() {
+      if (!scope.isActive) return
+      quickJs.startTimers(bucketId)
+      scope.launch(start = UNDISPATCHED) {
+        delay(delayMillis.toLong())
+        scope.ensureActive() // Necessary as delay() won't detect cancellation if the duration is 0.
+        quickJs.runTimers(bucketId)
+      }
+    }
+  }
+
   private inner class DelayedJob(
     val timeoutId: Int,
     val delayMillis: Int,
@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2026 Block, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package app.cash.zipline.internal
+
+/**
+ * Schedules the timers that the guest registers with the native `setTimeout()` installed by
+ * [app.cash.zipline.QuickJs.initTimers].
+ *
+ * Timers with the same delay share a bucket until the host calls
+ * [app.cash.zipline.QuickJs.startTimers]. Call [app.cash.zipline.QuickJs.runTimers] once
+ * [delayMillis] have elapsed after that.
+ */
+internal fun interface TimerScheduler {
+  fun scheduleTimers(bucketId: Int, delayMillis: Int)
+}
@@ -196,5 +196,62 @@ class FinalizationRegistryTest {
     )
   }
 
+  @Test
+  fun registerDoesNotChangeTargetShape() {
+    quickJs.evaluate(
+      """
+      const registry = new FinalizationRegistry(heldValue => {
+        log.push(heldValue);
+      });
+
+      globalThis.heavyObject = {
+        data: 'this data is owned by the heavy object.'
+      };
+      registry.register(heavyObject, 'heavy object was finalized');
+      log.push(Object.getOwnPropertyNames(heavyObject));
+      """.trimIndent(),
+    )
+    assertEquals(
+      """[["data"]]""",
+      takeLog(),
+    )
+  }
+
+  @Test
+  fun unregisteredValueNotFinalized() {
+    quickJs.evaluate(
+      """
+      const registry = new FinalizationRegistry(heldValue => {
+        log.push(heldValue);
+      });
+
+      globalThis.token = {};
+      function makeFinalizableObject(name) {
+        const heavyObject = {
+          data: 'this data is owned by the heavy object.'
+        };
+        registry.register(heavyObject, name, token);
+        heavyObject.cycle = {
+          heavyObject: heavyObject
+        };
+      }
+
+      makeFinalizableObject('red');
+      makeFinalizableObject('green');
+      log.push(registry.unregister(token), registry.unregister(token));
+      """.trimIndent(),
+    )
+    assertEquals(
+      """[true,false]""",
+      takeLog(),
+    )
+
+    quickJs.gc()
+    assertEquals(
+      """[]""",
+      takeLog(),
+    )
+  }
+
   private fun takeLog() = quickJs.evaluate("takeLog()")
 }
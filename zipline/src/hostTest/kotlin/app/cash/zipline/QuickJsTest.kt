@@ -22,8 +22,10 @@ import kotlin.test.Test
 import kotlin.test.assertContentEquals
 import kotlin.test.assertEquals
 import kotlin.test.assertFailsWith
+import kotlin.test.assertFalse
 import kotlin.test.assertNotEquals
 import kotlin.test.assertNull
+import kotlin.test.assertTrue
 
 class QuickJsTest {
   private val quickJs = QuickJs.create()
@@ -66,6 +68,329 @@ class QuickJsTest {
     )
   }
 
+  @Test fun jsonParse() {
+    assertEquals(
+      """{"a":[1,-2,1.5,12345678901,true,false,null],"b":"é😀\"\n","c":{}}""",
+      quickJs.evaluate(
+        """
+        JSON.stringify(JSON.parse(
+          ' { "a" : [1, -2, 1.5e0, 12345678901, true, false, null], ' +
+          ' "b" : "\\u00e9\\ud83d\\ude00\\"\\n", "c" : {} } '
+        ));
+        """.trimIndent(),
+      ),
+    )
+    assertEquals(true, quickJs.evaluate("""Object.is(JSON.parse("-0"), -0);"""))
+    assertEquals(2, quickJs.evaluate("""JSON.parse('{"a":1,"a":2}').a;"""))
+
+    val t = assertFailsWith<QuickJsException> {
+      quickJs.evaluate("""JSON.parse("[1,]");""")
+    }
+    assertEquals("unexpected token: ']'", t.message)
+  }
+
+  @Test fun jsonParseRecurringStrings() {
+    assertEquals(
+      "service:a,service:b,service:a+",
+      quickJs.evaluate(
+        """
+        const results = [];
+        for (const name of ['a', 'b', 'a']) {
+          const call = JSON.parse('{"service":"service:' + name + '"}');
+          results.push(call.service);
+        }
+        results[2] += '+';
+        results.join();
+        """.trimIndent(),
+      ),
+    )
+  }
+
+  @Test fun jsonStringify() {
+    assertEquals(
+      """{"2":3,"a":[1,null,1.5,"é😀\"\n\u0001"],"c":{},"e":[null]}""",
+      quickJs.evaluate(
+        """
+        JSON.stringify({
+          a: [1, undefined, 1.5, 'é😀"\n\u0001'],
+          b: undefined,
+          c: {},
+          d: Symbol('d'),
+          e: [-0 / 0],
+          2: 3,
+        });
+        """.trimIndent(),
+      ),
+    )
+    assertEquals(
+      """{"a":"A","b":{"c":2}}""",
+      quickJs.evaluate(
+        """
+        const o = { a: { toJSON() { return 'A'; } } };
+        Object.defineProperty(o, 'b', { get() { return { c: 2 }; }, enumerable: true });
+        JSON.stringify(o);
+        """.trimIndent(),
+      ),
+    )
+
+    val t = assertFailsWith<QuickJsException> {
+      quickJs.evaluate("""const cycle = [{}]; cycle[0].cycle = cycle; JSON.stringify(cycle);""")
+    }
+    assertEquals("circular reference", t.message)
+  }
+
+  @Test fun numberConversions() {
+    assertEquals(
+      """["0.1","0.30000000000000004","1.5e-7","1e+21","5e+0","0.3333333333333333",1.7976931348623157e+308,true,[9007199254740992,1e+23,-0.005]]""",
+      quickJs.evaluate(
+        """
+        JSON.stringify([
+          String(0.1),
+          String(0.1 + 0.2),
+          String(1.5e-7),
+          String(1e21),
+          (5).toExponential(),
+          String(1 / 3),
+          Number('1.7976931348623157e308'),
+          Object.is(Number('-0.0'), -0),
+          JSON.parse('[9007199254740993, 1e23, -5e-3]'),
+        ]);
+        """.trimIndent(),
+      ),
+    )
+  }
+
+  @Test fun stringConcatenation() {
+    assertEquals(
+      """[88890,"m9998,item9999,",300,301,"xx!"]""",
+      quickJs.evaluate(
+        """
+        (function() {
+          let s = '';
+          for (let i = 0; i < 10000; i++) s += 'item' + i + ',';
+          const o = { s: 'x'.repeat(300) };
+          const alias = o.s;
+          o.s = o.s + '!';
+          return JSON.stringify([s.length, s.slice(-15), alias.length, o.s.length, o.s.slice(-3)]);
+        })();
+        """.trimIndent(),
+      ),
+    )
+  }
+
+  @Test fun stringSearch() {
+    assertEquals(
+      """[1000,1001,1000,true,false,3,"[a]--[ā]"]""",
+      quickJs.evaluate(
+        """
+        const haystack = 'abcdefghij'.repeat(100) + 'needle';
+        JSON.stringify([
+          haystack.indexOf('needle'),
+          ('ā' + haystack).indexOf('needle'),
+          haystack.indexOf('n', 900),
+          haystack.includes('jn'),
+          haystack.includes('ā'),
+          'a--ā--'.split('--').length,
+          'a--ā'.replace('a', '[a]').replace('ā', '[ā]'),
+        ]);
+        """.trimIndent(),
+      ),
+    )
+  }
+
+  @Test fun caseConversionAndNormalization() {
+    assertEquals(
+      """["hello, wörld! ÷×","HELLO, WÖRLD! ÷×","STRASSE ŸΜ","ας",true,true,true,"RangeError"]""",
+      quickJs.evaluate(
+        """
+        const s = 'Hello, WÖrld! ÷×';
+        let error;
+        try { s.normalize('nfc'); } catch (e) { error = e.name; }
+        JSON.stringify([
+          s.toLowerCase(),
+          s.toUpperCase(),
+          'straße ÿµ'.toUpperCase(),
+          'ΑΣ'.toLowerCase(),
+          s.normalize() === s,
+          s.normalize('NFD') === 'Hello, WO\u0308rld! ÷×',
+          '\u212b'.normalize() === '\u00c5',
+          error,
+        ]);
+        """.trimIndent(),
+      ),
+    )
+  }
+
+  @Test fun mapAndSetKeys() {
+    assertEquals(
+      """[5,"zero","one","ab",true,false,9000,"1,3,5,b"]""",
+      quickJs.evaluate(
+        """
+        const map = new Map([[0, 'zero'], [1, 'one'], [1.5, 'x'], ['ab', 'ab'], [NaN, 'nan']]);
+        const set = new Set();
+        for (let i = 0; i < 10000; i++) set.add(i);
+        for (let i = 0; i < 10000; i += 10) set.delete(i);
+        const ordered = new Set([1, 2, 3, 4, 5, 'a', 'b']);
+        for (const value of ordered) if (value === 2 || value === 4 || value === 'a') ordered.delete(value);
+        JSON.stringify([
+          map.size,
+          map.get(-0),
+          map.get(1.0),
+          map.get('a' + 'b'),
+          map.has(0 / 0),
+          set.has(20),
+          set.size,
+          [...ordered].join(),
+        ]);
+        """.trimIndent(),
+      ),
+    )
+  }
+
+  @Test fun arraySearch() {
+    assertEquals(
+      """[2,1,-1,true,false,2,4,6,0,-1,0]""",
+      quickJs.evaluate(
+        """
+        const o = {};
+        const a = [1, 1.5, 2.0, NaN, 'ab', -0, o, undefined];
+        const holes = [1, 2];
+        holes.length = 6;
+        JSON.stringify([
+          a.indexOf(2),
+          a.indexOf(1.5, 1),
+          a.indexOf(NaN),
+          a.includes(NaN),
+          a.includes('a'),
+          a.lastIndexOf(2),
+          a.lastIndexOf('a' + 'b'),
+          a.indexOf(o),
+          a.lastIndexOf(1, 4),
+          holes.indexOf(undefined),
+          holes.lastIndexOf(undefined) + holes.includes(undefined),
+        ]);
+        """.trimIndent(),
+      ),
+    )
+  }
+
+  @Test fun arraySort() {
+    assertEquals(
+      """[[-5,-50,1,10,2,9],[-50,-5,1,2,9,10],[10,9,2,1,-5,-50],["B","a","b","é"],[-1.5,0,0.5,null],[1,2,null,null]]""",
+      quickJs.evaluate(
+        """
+        const ints = [10, 9, 1, -5, 2, -50];
+        JSON.stringify([
+          ints.slice().sort(),
+          ints.slice().sort((a, b) => a - b),
+          ints.slice().sort(function(a, b) { return b - a; }),
+          ['é', 'b', 'a', 'B'].sort(),
+          [0.5, undefined, 0, -1.5].sort((a, b) => a - b),
+          [2, undefined, 1, undefined].sort(),
+        ]);
+        """.trimIndent(),
+      ),
+    )
+  }
+
+  @Test fun typedArrayBulkOperations() {
+    assertEquals(
+      """[[1,2,1,0,2,0,3,0],[0,-1.5,-1.5,0],[0,254,255],999,2,1]""",
+      quickJs.evaluate(
+        """
+        const bytes = new Uint8Array([1, 2, 3, 4, 5, 6, 7, 8]);
+        new Uint16Array(bytes.buffer, 2, 3).set(bytes.subarray(0, 3));
+        const clamped = new Uint8ClampedArray(3);
+        clamped.set(new Float64Array([-1, 254.5, 300]));
+        const shorts = new Int16Array(1000);
+        shorts[999] = -2;
+        JSON.stringify([
+          Array.from(bytes),
+          Array.from(new Float32Array(4).fill(-1.5, 1, 3)),
+          Array.from(clamped),
+          shorts.indexOf(-2),
+          new Uint32Array([0, 7, 7]).lastIndexOf(7),
+          new Float32Array([1, 0.5]).indexOf(0.5),
+        ]);
+        """.trimIndent(),
+      ),
+    )
+  }
+
+  @Test fun regExpLiteralPrefix() {
+    assertEquals(
+      """[["at Foo.bar(Foo.kt:12)","Foo.bar","12"],["ab","ab"],null,"x[abc]āb[abc]"]""",
+      quickJs.evaluate(
+        """
+        const trace = 'x'.repeat(1000) + 'at Foo.bar(Foo.kt:12)';
+        JSON.stringify([
+          /at ([\w.]+)\([^:]+:(\d+)\)/.exec(trace),
+          'aabab'.match(/ab/g),
+          /ab/y.exec('xab'),
+          'xabcābabc'.replace(/a(b)c/g, '[$&]'),
+        ]);
+        """.trimIndent(),
+      ),
+    )
+  }
+
+  @Test fun regExpConstructedRepeatedly() {
+    assertEquals(
+      "[0,2,0,\"gi\",true,\"SyntaxError\"]",
+      quickJs.evaluate(
+        """
+        const a = new RegExp('ab', 'gi');
+        const b = new RegExp('ab', 'ig');
+        a.lastIndex = 1;
+        let error;
+        try { new RegExp('(', ''); } catch (e) { error = e.name; }
+        JSON.stringify([b.lastIndex, a.exec('abAB').index, b.exec('abAB').index, b.flags, a !== b, error]);
+        """.trimIndent(),
+      ),
+    )
+  }
+
+  @Test fun predefinedAtomsAreIndependentPerRuntime() {
+    val other = QuickJs.create()
+    try {
+      other.evaluate("globalThis.length = 'other'; Symbol.iterator.description;")
+      assertEquals(
+        """["length","Symbol.iterator",true,3]""",
+        quickJs.evaluate(
+          """
+          const o = { length: 1, prototype: 2, constructor: 3 };
+          JSON.stringify([
+            Object.keys(o)[0],
+            Symbol.iterator.description,
+            typeof [][Symbol.iterator] === 'function',
+            o.constructor,
+          ]);
+          """.trimIndent(),
+        ),
+      )
+    } finally {
+      other.close()
+    }
+    assertEquals("length", quickJs.evaluate("'len' + 'gth'"))
+  }
+
+  @Test fun executePendingJobs() {
+    quickJs.evaluate(
+      """
+      globalThis.log = [];
+      for (let i = 0; i < 10; i++) Promise.resolve(i).then(value => log.push(value));
+      """.trimIndent(),
+    )
+    assertEquals("", quickJs.evaluate("log.join()"))
+
+    assertTrue(quickJs.executePendingJobs(maxJobs = 3, budgetNanos = 0L))
+    assertEquals("0,1,2", quickJs.evaluate("log.join()"))
+
+    assertFalse(quickJs.executePendingJobs(maxJobs = 0, budgetNanos = Long.MAX_VALUE))
+    assertEquals("0,1,2,3,4,5,6,7,8,9", quickJs.evaluate("log.join()"))
+    assertFalse(quickJs.executePendingJobs(maxJobs = 0, budgetNanos = 0L))
+  }
+
   @Test fun gc() {
     assertNull(quickJs.evaluate("""globalThis.gc();"""))
   }
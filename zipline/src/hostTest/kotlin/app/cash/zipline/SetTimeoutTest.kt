@@ -57,6 +57,26 @@ class SetTimeoutTest {
     assertEquals("goodbye", zipline.quickJs.evaluate("greeting"))
   }
 
+  @Test fun timersRunInDelayOrderAndCanBeCleared() = runTest(dispatcher) {
+    zipline.quickJs.evaluate(
+      """
+      var log = [];
+
+      setTimeout(function() { log.push('c'); }, 200);
+      for (var i = 0; i < 1000; i++) {
+        setTimeout(function(i) { if (i % 250 == 0) log.push('a' + i); }, 100, i);
+      }
+      var b = setTimeout(function() { log.push('b'); }, 100);
+      clearTimeout(b);
+      """,
+    )
+
+    delay(150L)
+    assertEquals("a0,a250,a500,a750", zipline.quickJs.evaluate("log.join()"))
+    delay(100L)
+    assertEquals("a0,a250,a500,a750,c", zipline.quickJs.evaluate("log.join()"))
+  }
+
   @Test fun ziplineCloseSilentlyCancelsQueuedTasks() = runTest(dispatcher) {
     zipline.quickJs.evaluate(
       """
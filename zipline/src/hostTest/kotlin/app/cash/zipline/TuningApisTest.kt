@@ -18,6 +18,7 @@ package app.cash.zipline
 import kotlin.test.AfterTest
 import kotlin.test.Test
 import kotlin.test.assertEquals
+import kotlin.test.assertFalse
 import kotlin.test.assertTrue
 
 class TuningApisTest {
@@ -32,6 +33,10 @@ class TuningApisTest {
     assertEquals(-1, quickjs.memoryLimit)
     assertEquals(256L * 1024L, quickjs.gcThreshold)
     assertEquals(512L * 1024L, quickjs.maxStackSize)
+    assertEquals(GcPolicy.Fixed, quickjs.gcPolicy)
+    assertEquals(false, quickjs.generationalGc)
+    assertEquals(false, quickjs.incrementalGc)
+    assertEquals(false, quickjs.deferredFree)
   }
 
   @Test fun setMemoryLimit() {
@@ -47,6 +52,139 @@ class TuningApisTest {
     assertEquals(value, quickjs.gcThreshold)
   }
 
+  @Test fun setGcPolicy() {
+    quickjs.gcPolicy = GcPolicy.MemoryLimit
+    assertEquals(GcPolicy.MemoryLimit, quickjs.gcPolicy)
+  }
+
+  @Test fun setGenerationalGc() {
+    quickjs.generationalGc = true
+    assertEquals(true, quickjs.generationalGc)
+  }
+
+  @Test fun generationalGcCollectsCycles() {
+    quickjs.generationalGc = true
+    quickjs.gcThreshold = 64L * 1024L
+    val before = quickjs.gcStats
+    quickjs.evaluate(
+      """
+      globalThis.log = [];
+      const registry = new FinalizationRegistry(heldValue => log.push(heldValue));
+      (function() {
+        const cycle = {};
+        cycle.self = cycle;
+        registry.register(cycle, 'cycle collected');
+      })();
+      globalThis.retained = [];
+      for (let i = 0; i < 10000; i++) {
+        retained.push({ i });
+      }
+      """.trimIndent(),
+    )
+    assertEquals("""["cycle collected"]""", quickjs.evaluate("JSON.stringify(log)"))
+
+    // Only minor collections ran, so one of them freed the cycle.
+    val after = quickjs.gcStats
+    assertTrue(after.minorGcCount > before.minorGcCount)
+    assertTrue(after.minorGcObjectsFreed > before.minorGcObjectsFreed)
+    assertEquals(before.fullGcCount, after.fullGcCount)
+  }
+
+  @Test fun incrementalGcDefersCollectionToGcStep() {
+    quickjs.incrementalGc = true
+    quickjs.gcThreshold = 64L * 1024L
+    quickjs.evaluate(
+      """
+      globalThis.log = [];
+      const registry = new FinalizationRegistry(heldValue => log.push(heldValue));
+      (function() {
+        const cycle = {};
+        cycle.self = cycle;
+        registry.register(cycle, 'cycle collected');
+      })();
+      """.trimIndent(),
+    )
+    assertEquals("[]", quickjs.evaluate("JSON.stringify(log)"))
+
+    assertFalse(quickjs.gcStep(Long.MAX_VALUE))
+    assertEquals("""["cycle collected"]""", quickjs.evaluate("JSON.stringify(log)"))
+  }
+
+  @Test fun incrementalGcRunsPendingCollectionOnceTheHeapDoubles() {
+    quickjs.incrementalGc = true
+    quickjs.generationalGc = true
+    quickjs.gcThreshold = 64L * 1024L
+    val before = quickjs.gcStats
+    quickjs.evaluate(
+      """
+      globalThis.retained = [];
+      for (let i = 0; i < 100000; i++) {
+        retained.push({ i });
+      }
+      """.trimIndent(),
+    )
+    assertTrue(quickjs.gcStats.fullGcCount > before.fullGcCount)
+  }
+
+  @Test fun gcStatsCountsCollectionsAndAllocations() {
+    val initial = quickjs.gcStats
+    quickjs.evaluate(
+      """
+      (function() {
+        for (let i = 0; i < 100; i++) {
+          const cycle = {};
+          cycle.self = cycle;
+        }
+      })();
+      """.trimIndent(),
+    )
+    val before = quickjs.gcStats
+    assertTrue(before.allocatedCount > initial.allocatedCount, before.toString())
+    assertTrue(before.allocatedSize > initial.allocatedSize, before.toString())
+    assertEquals(before.allocatedCount, quickjs.gcStats.allocatedCount)
+
+    quickjs.gc()
+    val after = quickjs.gcStats
+    assertEquals(before.fullGcCount + 1L, after.fullGcCount)
+    assertTrue(after.fullGcObjectsFreed >= before.fullGcObjectsFreed + 100L, after.toString())
+    assertTrue(after.pauseTotalNanos > before.pauseTotalNanos, after.toString())
+    assertTrue(after.pauseMaxNanos in 1L..after.pauseTotalNanos, after.toString())
+  }
+
+  @Test fun gcListenerNotifiedAfterEachCollection() {
+    val log = mutableListOf<GcStats>()
+    quickjs.gcListener = GcListener { stats -> log += stats }
+
+    quickjs.gc()
+    quickjs.gc()
+    assertEquals(2, log.size)
+    assertEquals(log[0].fullGcCount + 1L, log[1].fullGcCount)
+
+    quickjs.gcListener = null
+    quickjs.gc()
+    assertEquals(2, log.size)
+  }
+
+  @Test fun deferredFreeReleasesLargeBlocks() {
+    quickjs.deferredFree = true
+    val before = quickjs.memoryUsage
+    quickjs.evaluate(
+      """
+      (function() {
+        const strings = [];
+        for (let i = 0; i < 100; i++) strings.push('x'.repeat(64 * 1024) + i);
+        const buffer = new ArrayBuffer(4 * 1024 * 1024);
+      })();
+      """.trimIndent(),
+    )
+    quickjs.gc()
+    val after = quickjs.memoryUsage
+    assertTrue(
+      after.memoryAllocatedSize < before.memoryAllocatedSize + 1024L * 1024L,
+      "before=$before after=$after",
+    )
+  }
+
   @Test fun setMaxStackSize() {
     val value = 1024L * 1024L + 3L
     quickjs.maxStackSize = value
@@ -105,6 +243,28 @@ class TuningApisTest {
     assertEquals(diff.fastArraysElementsCount, 0L) // Why isn't this (1024L * 1024L)?
   }
 
+  @Test fun objectsWithSamePropertiesShareShapes() {
+    val diff = diffMemoryUsage {
+      quickjs.evaluate(
+        """
+        function Point(x, y) {
+          this.x = x;
+          this.y = y;
+        }
+        globalThis.points = [];
+        for (let i = 0; i < 1000; i++) {
+          points.push(new Point(i, i), { a: i, b: i, c: i });
+        }
+        """,
+      )
+    }
+    assertTrue(diff.shapeCount < 10L, diff.toString())
+    assertEquals(
+      """[{"x":999,"y":999},{"a":999,"b":999,"c":999}]""",
+      quickjs.evaluate("JSON.stringify(points.slice(-2))"),
+    )
+  }
+
   private fun diffMemoryUsage(block: () -> Unit): MemoryUsage {
     val before = quickjs.memoryUsage
     block()
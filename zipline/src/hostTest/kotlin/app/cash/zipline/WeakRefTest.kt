@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2026 Block, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package app.cash.zipline
+
+import kotlin.test.AfterTest
+import kotlin.test.BeforeTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+
+class WeakRefTest {
+  private val quickJs = QuickJs.create()
+
+  @BeforeTest
+  fun setUp() {
+    quickJs.evaluate(
+      """
+      globalThis.log = [];
+
+      function takeLog() {
+        const result = JSON.stringify(log);
+        log.length = 0;
+        return result;
+      };
+      """,
+    )
+  }
+
+  @AfterTest
+  fun tearDown() {
+    quickJs.close()
+  }
+
+  @Test
+  fun derefReturnsTargetUntilItIsCollected() {
+    quickJs.evaluate(
+      """
+      globalThis.target = { name: 'target' };
+      globalThis.weakRef = new WeakRef(target);
+      log.push(weakRef.deref().name);
+      """.trimIndent(),
+    )
+    assertEquals(
+      """["target"]""",
+      takeLog(),
+    )
+
+    quickJs.evaluate(
+      """
+      delete globalThis.target;
+      """.trimIndent(),
+    )
+
+    quickJs.evaluate(
+      """
+      log.push(typeof weakRef.deref());
+      """.trimIndent(),
+    )
+    assertEquals(
+      """["undefined"]""",
+      takeLog(),
+    )
+  }
+
+  @Test
+  fun derefKeepsTargetUntilTheJobCompletes() {
+    quickJs.evaluate(
+      """
+      globalThis.target = { name: 'target' };
+      globalThis.weakRef = new WeakRef(target);
+      """.trimIndent(),
+    )
+
+    quickJs.evaluate(
+      """
+      log.push(weakRef.deref().name);
+      delete globalThis.target;
+      log.push(weakRef.deref().name);
+      """.trimIndent(),
+    )
+    assertEquals(
+      """["target","target"]""",
+      takeLog(),
+    )
+
+    quickJs.evaluate(
+      """
+      log.push(typeof weakRef.deref());
+      """.trimIndent(),
+    )
+    assertEquals(
+      """["undefined"]""",
+      takeLog(),
+    )
+  }
+
+  @Test
+  fun weakMapValueReferencingItsKeyIsCollected() {
+    quickJs.evaluate(
+      """
+      const registry = new FinalizationRegistry(heldValue => {
+        log.push(heldValue);
+      });
+
+      globalThis.weakMap = new WeakMap();
+      function addEntry() {
+        const key = {};
+        weakMap.set(key, { key: key });
+        registry.register(key, 'key was finalized');
+      }
+
+      addEntry();
+      """.trimIndent(),
+    )
+    assertEquals(
+      """[]""",
+      takeLog(),
+    )
+
+    quickJs.gc()
+    assertEquals(
+      """["key was finalized"]""",
+      takeLog(),
+    )
+  }
+
+  @Test
+  fun weakMapValueKeptWhileItsKeyIsReachable() {
+    quickJs.evaluate(
+      """
+      globalThis.weakMap = new WeakMap();
+      globalThis.first = {};
+      function addEntries() {
+        const second = {};
+        const third = {};
+        weakMap.set(first, second);
+        weakMap.set(second, third);
+        weakMap.set(third, 'third value');
+        globalThis.weakRef = new WeakRef(third);
+      }
+
+      addEntries();
+      """.trimIndent(),
+    )
+
+    quickJs.gc()
+    assertEquals(
+      "third value",
+      quickJs.evaluate("weakMap.get(weakMap.get(weakMap.get(first)))"),
+    )
+
+    quickJs.evaluate("delete globalThis.first")
+    quickJs.gc()
+    assertEquals(
+      "undefined",
+      quickJs.evaluate("typeof weakRef.deref()"),
+    )
+  }
+
+  private fun takeLog() = quickJs.evaluate("takeLog()")
+}
@@ -15,11 +15,13 @@
  */
 package app.cash.zipline
 
+import app.cash.zipline.internal.TimerScheduler
 import app.cash.zipline.internal.bridge.CallChannel
 import app.cash.zipline.internal.bridge.INBOUND_CHANNEL_NAME
 import app.cash.zipline.internal.bridge.OUTBOUND_CHANNEL_NAME
 import app.cash.zipline.internal.log
 import java.io.Closeable
+import java.nio.ByteBuffer
 
 /**
  * An EMCAScript (Javascript) interpreter backed by the 'QuickJS' native engine.
@@ -80,6 +82,20 @@ actual class QuickJs private constructor(
   actual val memoryUsage: MemoryUsage
     get() = memoryUsage(context) ?: throw AssertionError()
 
+  /**
+   * Garbage collection statistics for the JavaScript engine. This is cheap enough to read
+   * frequently. All counters are cumulative; subtract an earlier value to measure an interval.
+   */
+  actual val gcStats: GcStats
+    get() = gcStats(context) ?: throw AssertionError()
+
+  /** Notified after each garbage collection. Default is null. */
+  actual var gcListener: GcListener? = null
+    set(value) {
+      field = value
+      setGcListener(context, value)
+    }
+
   /** Default is -1. Use -1 for no limit. */
   actual var memoryLimit: Long = -1L
     set(value) {
@@ -94,6 +110,46 @@ actual class QuickJs private constructor(
       setGcThreshold(context, value)
     }
 
+  /** Default is [GcPolicy.Fixed]. */
+  actual var gcPolicy: GcPolicy = GcPolicy.Fixed
+    set(value) {
+      field = value
+      setGcPolicy(context, value.ordinal)
+    }
+
+  /**
+   * Default is false. When true, automatic GC only looks for cycles among objects that were
+   * allocated or mutated since the previous collection. Every few collections it scans the whole
+   * heap, which is what [gc] always does.
+   */
+  actual var generationalGc: Boolean = false
+    set(value) {
+      field = value
+      setGenerationalGc(context, value)
+    }
+
+  /**
+   * Default is false. When true, crossing [gcThreshold] doesn't run a full collection on the
+   * calling thread. Instead that work is left pending for [gcStep]. (If the heap doubles while a
+   * collection is pending, it runs anyway.)
+   */
+  actual var incrementalGc: Boolean = false
+    set(value) {
+      field = value
+      setIncrementalGc(context, value)
+    }
+
+  /**
+   * Default is false. When true, large blocks of memory released by JavaScript (big strings,
+   * arrays, and array buffers) are returned to the system allocator on a background thread. This
+   * keeps the calling thread's pauses short when a large object graph is freed.
+   */
+  actual var deferredFree: Boolean = false
+    set(value) {
+      field = value
+      setDeferredFree(context, value)
+    }
+
   /** Default is 512 KiB. Use 0 to disable the maximum stack size check. */
   actual var maxStackSize: Long = -1L
     set(value) {
@@ -116,6 +172,18 @@ actual class QuickJs private constructor(
     setOutboundCallChannel(context, OUTBOUND_CHANNEL_NAME, outboundChannel)
   }
 
+  internal actual fun initTimers(timerScheduler: TimerScheduler) {
+    initTimers(context, timerScheduler)
+  }
+
+  internal actual fun startTimers(bucketId: Int) {
+    startTimers(context, bucketId)
+  }
+
+  internal actual fun runTimers(bucketId: Int) {
+    runTimers(context, bucketId)
+  }
+
   internal actual fun getInboundChannel(): CallChannel {
     val instance = getInboundCallChannel(context, INBOUND_CHANNEL_NAME)
     if (instance == 0L) {
@@ -129,6 +197,55 @@ actual class QuickJs private constructor(
     gc(context)
   }
 
+  /**
+   * Performs pending garbage collection work if it is expected to fit within [budgetNanos]. Use
+   * this with [incrementalGc] to collect garbage from an idle handler.
+   *
+   * A full collection can't be split across calls. It runs to completion if the previous one took
+   * no longer than [budgetNanos], and is skipped otherwise. The budget only decides whether to
+   * start; it doesn't bound how long this call takes.
+   *
+   * Returns true if work remains pending.
+   */
+  actual fun gcStep(budgetNanos: Long): Boolean {
+    return gcStep(context, budgetNanos)
+  }
+
+  /**
+   * Defines the global JavaScript `ArrayBuffer` [name] over the memory of [buffer], without
+   * copying. The `ArrayBuffer` covers the bytes between the buffer's position and its limit.
+   *
+   * [buffer] must be direct and writable. It stays reachable until JavaScript no longer
+   * references the `ArrayBuffer`, either because it was garbage collected or because this instance
+   * was closed. [onRelease] is called then. It may run during any allocation, so it must not
+   * throw; exceptions it throws are logged and ignored.
+   */
+  fun setArrayBuffer(name: String, buffer: ByteBuffer, onRelease: Runnable?) {
+    require(buffer.isDirect) { "buffer is not direct" }
+    require(!buffer.isReadOnly) { "buffer is read-only" }
+    setArrayBuffer(context, name, buffer.slice(), onRelease)
+  }
+
+  /**
+   * Returns a direct buffer that shares the memory of the global JavaScript `ArrayBuffer` [name],
+   * or null if that global isn't an `ArrayBuffer`.
+   *
+   * The `ArrayBuffer` is retained, even if JavaScript replaces or deletes the global, until the
+   * returned buffer is passed to [releaseArrayBuffer] or this instance is closed. Don't use the
+   * returned buffer after that.
+   */
+  fun getArrayBuffer(name: String): ByteBuffer? {
+    return getArrayBuffer(context, name)
+  }
+
+  /**
+   * Releases the `ArrayBuffer` retained for [buffer], which must have been returned by
+   * [getArrayBuffer] and not released yet. Don't use [buffer] after calling this.
+   */
+  fun releaseArrayBuffer(buffer: ByteBuffer) {
+    releaseArrayBuffer(context, buffer)
+  }
+
   /**
    * Compile [sourceCode] and return the bytecode. [fileName] will be used in error
    * reporting.
@@ -148,6 +265,19 @@ actual class QuickJs private constructor(
     return execute(context, bytecode)
   }
 
+  /**
+   * Runs pending jobs, like promise reactions, until none remain, [maxJobs] jobs have run, or
+   * [budgetNanos] have elapsed. A limit of 0 or less means no limit. This is much cheaper than
+   * running jobs one call at a time.
+   *
+   * Returns true if jobs remain pending.
+   *
+   * @throws QuickJsException if a job throws.
+   */
+  actual fun executePendingJobs(maxJobs: Int, budgetNanos: Long): Boolean {
+    return executePendingJobs(context, maxJobs, budgetNanos)
+  }
+
   actual override fun close() {
     val contextToClose = context
     if (contextToClose != 0L) {
@@ -165,14 +295,28 @@ actual class QuickJs private constructor(
   private external fun destroyContext(context: Long)
   private external fun getInboundCallChannel(context: Long, name: String): Long
   private external fun setOutboundCallChannel(context: Long, name: String, callChannel: CallChannel)
+  private external fun initTimers(context: Long, timerScheduler: TimerScheduler)
+  private external fun startTimers(context: Long, bucketId: Int)
+  private external fun runTimers(context: Long, bucketId: Int)
   private external fun execute(context: Long, bytecode: ByteArray): Any?
+  private external fun executePendingJobs(context: Long, maxJobs: Int, budgetNanos: Long): Boolean
   private external fun compile(context: Long, sourceCode: String, fileName: String): ByteArray
   private external fun setInterruptHandler(context: Long, interruptHandler: InterruptHandler?)
   private external fun memoryUsage(context: Long): MemoryUsage?
+  private external fun gcStats(context: Long): GcStats?
+  private external fun setGcListener(context: Long, gcListener: GcListener?)
   private external fun setMemoryLimit(context: Long, limit: Long)
   private external fun setGcThreshold(context: Long, gcThreshold: Long)
+  private external fun setGcPolicy(context: Long, gcPolicy: Int)
+  private external fun setGenerationalGc(context: Long, generationalGc: Boolean)
+  private external fun setIncrementalGc(context: Long, incrementalGc: Boolean)
+  private external fun setDeferredFree(context: Long, deferredFree: Boolean)
   private external fun gc(context: Long)
+  private external fun gcStep(context: Long, budgetNanos: Long): Boolean
   private external fun setMaxStackSize(context: Long, stackSize: Long)
+  private external fun setArrayBuffer(context: Long, name: String, buffer: ByteBuffer, onRelease: Runnable?)
+  private external fun getArrayBuffer(context: Long, name: String): ByteBuffer?
+  private external fun releaseArrayBuffer(context: Long, buffer: ByteBuffer)
 }
 
 internal expect fun loadNativeLibrary()
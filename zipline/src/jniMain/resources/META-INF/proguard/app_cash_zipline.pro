@@ -6,5 +6,13 @@
   <init>(...);
 }
 
+# Type and constructor are resolved from JNI code when QuickJs is created.
+-keep class app.cash.zipline.GcStats {
+  <init>(...);
+}
+
 # Type name and functions resolved from JNI code.
 -keep app.cash.zipline.internal.bridge.CallChannel
+
+# Type name and functions resolved from JNI code when timers are initialized.
+-keep,allowoptimization interface app.cash.zipline.internal.TimerScheduler { * ; }
@@ -15,9 +15,12 @@
  */
 package app.cash.zipline
 
+import java.nio.ByteBuffer
 import kotlin.test.assertFailsWith
 import org.junit.After
 import org.junit.Assert.assertEquals
+import org.junit.Assert.assertFalse
+import org.junit.Assert.assertNull
 import org.junit.Assert.assertTrue
 import org.junit.Test
 
@@ -62,4 +65,60 @@ class QuickJsJvmTest {
       nowMillis in beforeMillis..afterMillis,
     )
   }
+
+  @Test fun arrayBuffersShareMemoryWithoutCopying() {
+    val hostBuffer = ByteBuffer.allocateDirect(4)
+    var released = false
+    quickjs.setArrayBuffer("hostBuffer", hostBuffer) { released = true }
+    quickjs.evaluate("new Uint8Array(hostBuffer).set([1, 2, 3, 4])")
+    assertEquals(0x01020304, hostBuffer.getInt(0))
+
+    hostBuffer.put(0, 9)
+    assertEquals(9, quickjs.evaluate("new Uint8Array(hostBuffer)[0]"))
+
+    quickjs.evaluate("globalThis.guestBuffer = new Uint8Array([5, 6, 7]).buffer")
+    val guestBuffer = quickjs.getArrayBuffer("guestBuffer")!!
+    assertEquals(3, guestBuffer.capacity())
+    guestBuffer.put(2, 8)
+    assertEquals("5,6,8", quickjs.evaluate("new Uint8Array(guestBuffer).join()"))
+    assertNull(quickjs.getArrayBuffer("dateNow"))
+
+    quickjs.evaluate("delete globalThis.hostBuffer")
+    quickjs.gc()
+    assertTrue(released)
+  }
+
+  @Test fun returnedArrayBuffersStayValidUntilReleased() {
+    quickjs.evaluate("globalThis.guestBuffer = new Uint8Array([1, 2, 3]).buffer")
+    val first = quickjs.getArrayBuffer("guestBuffer")!!
+    quickjs.evaluate("globalThis.guestBuffer = new Uint8Array([4, 5]).buffer")
+    val second = quickjs.getArrayBuffer("guestBuffer")!!
+    quickjs.gc()
+
+    first.put(0, 9)
+    assertEquals(9, first.get(0))
+    assertEquals(3, first.capacity())
+    assertEquals("4,5", quickjs.evaluate("new Uint8Array(guestBuffer).join()"))
+    assertEquals(2, second.capacity())
+  }
+
+  @Test fun releaseArrayBufferReleasesItOncePerReturnedBuffer() {
+    var released = false
+    quickjs.setArrayBuffer("hostBuffer", ByteBuffer.allocateDirect(4)) { released = true }
+    val first = quickjs.getArrayBuffer("hostBuffer")!!
+    val second = quickjs.getArrayBuffer("hostBuffer")!!
+    quickjs.evaluate("delete globalThis.hostBuffer")
+    quickjs.gc()
+    assertFalse(released)
+
+    quickjs.releaseArrayBuffer(first)
+    quickjs.gc()
+    assertFalse(released)
+
+    quickjs.releaseArrayBuffer(second)
+    assertTrue(released)
+    assertFailsWith<IllegalArgumentException> {
+      quickjs.releaseArrayBuffer(second)
+    }
+  }
 }
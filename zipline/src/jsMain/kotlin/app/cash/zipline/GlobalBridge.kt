@@ -42,12 +42,18 @@ internal object GlobalBridge : GuestService, CallChannel {
       """
       globalThis.app_cash_zipline_inboundChannel = globalBridge;
 
-      globalThis.setTimeout = function(handler, delay) {
-        return globalBridge.setTimeout(handler, delay, arguments);
-      };
-      globalThis.clearTimeout = function(timeoutID) {
-        return globalBridge.clearTimeout(timeoutID);
-      };
+      if (typeof globalThis.app_cash_zipline_setTimeout === 'function') {
+        // The host installed native timers. Use them directly rather than calling the host.
+        globalThis.setTimeout = globalThis.app_cash_zipline_setTimeout;
+        globalThis.clearTimeout = globalThis.app_cash_zipline_clearTimeout;
+      } else {
+        globalThis.setTimeout = function(handler, delay) {
+          return globalBridge.setTimeout(handler, delay, arguments);
+        };
+        globalThis.clearTimeout = function(timeoutID) {
+          return globalBridge.clearTimeout(timeoutID);
+        };
+      }
       globalThis.console = {
         error: function() { globalBridge.consoleMessage('error', arguments) },
         info: function() { globalBridge.consoleMessage('info', arguments) },
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2026 Block, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+@file:OptIn(ExperimentalForeignApi::class)
+
+package app.cash.zipline
+
+import app.cash.zipline.quickjs.JSValue
+import kotlinx.cinterop.ByteVar
+import kotlinx.cinterop.CPointer
+import kotlinx.cinterop.CValue
+import kotlinx.cinterop.ExperimentalForeignApi
+
+/** The memory of a JavaScript `ArrayBuffer`, as returned by [QuickJs.getArrayBuffer]. */
+@EngineApi
+class ArrayBufferMemory(
+  val data: CPointer<ByteVar>,
+  val size: Long,
+)
+
+/** An `ArrayBuffer` kept alive for the [ArrayBufferMemory] instances that share its memory. */
+internal class RetainedArrayBuffer(
+  val arrayBuffer: CValue<JSValue>,
+) {
+  var count = 1
+}
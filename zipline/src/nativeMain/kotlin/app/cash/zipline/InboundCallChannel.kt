@@ -25,10 +25,8 @@ import app.cash.zipline.quickjs.JS_GetGlobalObject
 import app.cash.zipline.quickjs.JS_GetPropertyStr
 import app.cash.zipline.quickjs.JS_Invoke
 import app.cash.zipline.quickjs.JS_NewAtom
-import app.cash.zipline.quickjs.JS_NewString
 import kotlinx.cinterop.ExperimentalForeignApi
 import kotlinx.cinterop.memScoped
-import kotlinx.cinterop.utf8
 
 internal class InboundCallChannel(
   private val quickJs: QuickJs,
@@ -41,7 +39,7 @@ internal class InboundCallChannel(
     val globalThis = JS_GetGlobalObject(context)
     val inboundChannel = JS_GetPropertyStr(context, globalThis, INBOUND_CHANNEL_NAME)
     val property = JS_NewAtom(context, "call")
-    val arg0 = JS_NewString(context, callJson.utf8)
+    val arg0 = with(quickJs) { callJson.toJsString() }
 
     val jsResult = memScoped {
       val args = allocArrayOf(arg0)
@@ -64,7 +62,7 @@ internal class InboundCallChannel(
     val globalThis = JS_GetGlobalObject(context)
     val inboundChannel = JS_GetPropertyStr(context, globalThis, INBOUND_CHANNEL_NAME)
     val property = JS_NewAtom(context, "disconnect")
-    val arg0 = JS_NewString(context, instanceName.utf8)
+    val arg0 = with(quickJs) { instanceName.toJsString() }
 
     val jsResult = memScoped {
       val args = allocArrayOf(arg0)
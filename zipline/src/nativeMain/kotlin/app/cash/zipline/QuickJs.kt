@@ -17,12 +17,14 @@
 
 package app.cash.zipline
 
+import app.cash.zipline.internal.TimerScheduler
 import app.cash.zipline.internal.bridge.CallChannel
 import app.cash.zipline.internal.bridge.INBOUND_CHANNEL_NAME
 import app.cash.zipline.internal.bridge.OUTBOUND_CHANNEL_NAME
 import app.cash.zipline.quickjs.JSClassDef
 import app.cash.zipline.quickjs.JSClassIDVar
 import app.cash.zipline.quickjs.JSContext
+import app.cash.zipline.quickjs.JSGCStats
 import app.cash.zipline.quickjs.JSMemoryUsage
 import app.cash.zipline.quickjs.JSRuntime
 import app.cash.zipline.quickjs.JSValue
@@ -32,11 +34,14 @@ import app.cash.zipline.quickjs.JS_EVAL_FLAG_COMPILE_ONLY
 import app.cash.zipline.quickjs.JS_EVAL_FLAG_STRICT
 import app.cash.zipline.quickjs.JS_Eval
 import app.cash.zipline.quickjs.JS_EvalFunction
+import app.cash.zipline.quickjs.JS_ExecutePendingJobs
 import app.cash.zipline.quickjs.JS_FreeAtom
 import app.cash.zipline.quickjs.JS_FreeContext
 import app.cash.zipline.quickjs.JS_FreeRuntime
 import app.cash.zipline.quickjs.JS_FreeValue
+import app.cash.zipline.quickjs.JS_GetArrayBuffer
 import app.cash.zipline.quickjs.JS_GetException
+import app.cash.zipline.quickjs.JS_GetGCStats
 import app.cash.zipline.quickjs.JS_GetGlobalObject
 import app.cash.zipline.quickjs.JS_GetPropertyStr
 import app.cash.zipline.quickjs.JS_GetPropertyUint32
@@ -45,26 +50,37 @@ import app.cash.zipline.quickjs.JS_GetRuntimeOpaque
 import app.cash.zipline.quickjs.JS_HasProperty
 import app.cash.zipline.quickjs.JS_IsArray
 import app.cash.zipline.quickjs.JS_IsException
+import app.cash.zipline.quickjs.JS_IsJobPending
 import app.cash.zipline.quickjs.JS_IsUndefined
+import app.cash.zipline.quickjs.JS_NewArrayBuffer
 import app.cash.zipline.quickjs.JS_NewAtom
 import app.cash.zipline.quickjs.JS_NewClass
 import app.cash.zipline.quickjs.JS_NewClassID
 import app.cash.zipline.quickjs.JS_NewContext
 import app.cash.zipline.quickjs.JS_NewContextNoEval
+import app.cash.zipline.quickjs.JS_NewError
 import app.cash.zipline.quickjs.JS_NewObjectClass
 import app.cash.zipline.quickjs.JS_NewRuntime
 import app.cash.zipline.quickjs.JS_NewString
+import app.cash.zipline.quickjs.JS_NewStringInterned
 import app.cash.zipline.quickjs.JS_READ_OBJ_BYTECODE
 import app.cash.zipline.quickjs.JS_READ_OBJ_REFERENCE
 import app.cash.zipline.quickjs.JS_ReadObject
 import app.cash.zipline.quickjs.JS_ResolveModule
 import app.cash.zipline.quickjs.JS_RunGC
+import app.cash.zipline.quickjs.JS_RunGCStep
+import app.cash.zipline.quickjs.JS_SetDeferredFree
+import app.cash.zipline.quickjs.JS_SetGCCallback
+import app.cash.zipline.quickjs.JS_SetGCPolicy
 import app.cash.zipline.quickjs.JS_SetGCThreshold
+import app.cash.zipline.quickjs.JS_SetGenerationalGC
+import app.cash.zipline.quickjs.JS_SetIncrementalGC
 import app.cash.zipline.quickjs.JS_SetInterruptHandler
 import app.cash.zipline.quickjs.JS_SetMaxStackSize
 import app.cash.zipline.quickjs.JS_SetMemoryLimit
 import app.cash.zipline.quickjs.JS_SetProperty
 import app.cash.zipline.quickjs.JS_SetPropertyFunctionList
+import app.cash.zipline.quickjs.JS_SetPropertyStr
 import app.cash.zipline.quickjs.JS_SetRuntimeOpaque
 import app.cash.zipline.quickjs.JS_TAG_BOOL
 import app.cash.zipline.quickjs.JS_TAG_EXCEPTION
@@ -74,6 +90,7 @@ import app.cash.zipline.quickjs.JS_TAG_NULL
 import app.cash.zipline.quickjs.JS_TAG_OBJECT
 import app.cash.zipline.quickjs.JS_TAG_STRING
 import app.cash.zipline.quickjs.JS_TAG_UNDEFINED
+import app.cash.zipline.quickjs.JS_Throw
 import app.cash.zipline.quickjs.JS_ToCString
 import app.cash.zipline.quickjs.JS_WRITE_OBJ_BYTECODE
 import app.cash.zipline.quickjs.JS_WRITE_OBJ_REFERENCE
@@ -87,12 +104,14 @@ import app.cash.zipline.quickjs.JsValueGetBool
 import app.cash.zipline.quickjs.JsValueGetFloat64
 import app.cash.zipline.quickjs.JsValueGetInt
 import app.cash.zipline.quickjs.JsValueGetNormTag
-import app.cash.zipline.quickjs.installFinalizationRegistry
+import app.cash.zipline.quickjs.installTimers
 import app.cash.zipline.quickjs.js_free
 import kotlin.experimental.ExperimentalNativeApi
+import kotlinx.cinterop.ByteVar
 import kotlinx.cinterop.CArrayPointer
 import kotlinx.cinterop.COpaquePointer
 import kotlinx.cinterop.CPointer
+import kotlinx.cinterop.CPointerVar
 import kotlinx.cinterop.CValue
 import kotlinx.cinterop.CValuesRef
 import kotlinx.cinterop.ExperimentalForeignApi
@@ -107,6 +126,7 @@ import kotlinx.cinterop.nativeHeap
 import kotlinx.cinterop.ptr
 import kotlinx.cinterop.readBytes
 import kotlinx.cinterop.refTo
+import kotlinx.cinterop.reinterpret
 import kotlinx.cinterop.staticCFunction
 import kotlinx.cinterop.toKStringFromUtf8
 import kotlinx.cinterop.utf8
@@ -140,7 +160,6 @@ actual class QuickJs private constructor(
           memoryLimit = -1L
           gcThreshold = 256L * 1024L
           maxStackSize = 512L * 1024L // Override the QuickJS default which is 256 KiB
-          installFinalizationRegistry(context, contextForCompiling)
         }
     }
 
@@ -149,6 +168,7 @@ actual class QuickJs private constructor(
   }
 
   private val jsInterruptHandlerCFunction = staticCFunction(::jsInterruptHandlerGlobal)
+  private val jsGcCallbackCFunction = staticCFunction(::jsGcCallbackGlobal)
   private val thisPtr = StableRef.create(this)
   init {
     JS_SetRuntimeOpaque(runtime, thisPtr.asCPointer())
@@ -159,6 +179,9 @@ actual class QuickJs private constructor(
 
   private var closed = false
   private var outboundChannel: CallChannel? = null
+  private val retainedArrayBuffers = mutableMapOf<CPointer<ByteVar>, RetainedArrayBuffer>()
+  private var timerScheduler: TimerScheduler? = null
+  private var timers: CValue<JSValue>? = null
 
   internal fun jsInterruptHandler(runtime: CPointer<JSRuntime>?): Int {
     val interruptHandler = interruptHandler ?: return 0
@@ -185,6 +208,62 @@ actual class QuickJs private constructor(
       field = value
     }
 
+  internal fun jsGcCallback(runtime: CPointer<JSRuntime>?) {
+    val gcListener = gcListener ?: return
+
+    JS_SetGCCallback(runtime, null, null) // Suppress re-enter.
+
+    try {
+      gcListener.gcCompleted(readGcStats())
+    } catch (t: Throwable) {
+      // The collector may run inside any allocation, so there's no JS call to fail. Drop it.
+    } finally {
+      // Restore callback.
+      JS_SetGCCallback(runtime, jsGcCallbackCFunction, thisPtr.asCPointer())
+    }
+  }
+
+  /** Notified after each garbage collection. Default is null. */
+  actual var gcListener: GcListener? = null
+    set(value) {
+      checkNotClosed()
+
+      field = value
+      if (value != null) {
+        JS_SetGCCallback(runtime, jsGcCallbackCFunction, thisPtr.asCPointer())
+      } else {
+        JS_SetGCCallback(runtime, null, null)
+      }
+    }
+
+  /**
+   * Garbage collection statistics for the JavaScript engine. This is cheap enough to read
+   * frequently. All counters are cumulative; subtract an earlier value to measure an interval.
+   */
+  actual val gcStats: GcStats
+    get() {
+      checkNotClosed()
+
+      return readGcStats()
+    }
+
+  private fun readGcStats(): GcStats {
+    memScoped {
+      val jsGcStats = alloc<JSGCStats>()
+      JS_GetGCStats(runtime, jsGcStats.ptr)
+      return GcStats(
+        jsGcStats.full_gc_count,
+        jsGcStats.minor_gc_count,
+        jsGcStats.pause_total_ns,
+        jsGcStats.pause_max_ns,
+        jsGcStats.full_gc_freed_count,
+        jsGcStats.minor_gc_freed_count,
+        jsGcStats.alloc_count,
+        jsGcStats.alloc_size,
+      )
+    }
+  }
+
   /** Memory usage statistics for the JavaScript engine. */
   actual val memoryUsage: MemoryUsage
     get() {
@@ -242,6 +321,54 @@ actual class QuickJs private constructor(
       JS_SetGCThreshold(runtime, value.convert())
     }
 
+  /** Default is [GcPolicy.Fixed]. */
+  actual var gcPolicy: GcPolicy = GcPolicy.Fixed
+    set(value) {
+      checkNotClosed()
+
+      field = value
+      JS_SetGCPolicy(runtime, value.ordinal)
+    }
+
+  /**
+   * Default is false. When true, automatic GC only looks for cycles among objects that were
+   * allocated or mutated since the previous collection. Every few collections it scans the whole
+   * heap, which is what [gc] always does.
+   */
+  actual var generationalGc: Boolean = false
+    set(value) {
+      checkNotClosed()
+
+      field = value
+      JS_SetGenerationalGC(runtime, if (value) 1 else 0)
+    }
+
+  /**
+   * Default is false. When true, crossing [gcThreshold] doesn't run a full collection on the
+   * calling thread. Instead that work is left pending for [gcStep]. (If the heap doubles while a
+   * collection is pending, it runs anyway.)
+   */
+  actual var incrementalGc: Boolean = false
+    set(value) {
+      checkNotClosed()
+
+      field = value
+      JS_SetIncrementalGC(runtime, if (value) 1 else 0)
+    }
+
+  /**
+   * Default is false. When true, large blocks of memory released by JavaScript (big strings,
+   * arrays, and array buffers) are returned to the system allocator on a background thread. This
+   * keeps the calling thread's pauses short when a large object graph is freed.
+   */
+  actual var deferredFree: Boolean = false
+    set(value) {
+      checkNotClosed()
+
+      field = value
+      JS_SetDeferredFree(runtime, if (value) 1 else 0)
+    }
+
   /** Default is 512 KiB. Use 0 to disable the maximum stack size check. */
   actual var maxStackSize: Long = -1L
     set(value) {
@@ -256,6 +383,106 @@ actual class QuickJs private constructor(
     return execute(bytecode)
   }
 
+  /**
+   * Defines the global JavaScript `ArrayBuffer` [name] over the [size] bytes at [data], without
+   * copying.
+   *
+   * [data] must stay valid until JavaScript no longer references the `ArrayBuffer`, either because
+   * it was garbage collected or because this instance was closed. [onRelease] is called then. It
+   * may run during any allocation, so it must not throw; exceptions it throws are ignored.
+   */
+  fun setArrayBuffer(
+    name: String,
+    data: CPointer<ByteVar>,
+    size: Long,
+    onRelease: (() -> Unit)?,
+  ) {
+    checkNotClosed()
+
+    val onReleaseRef = onRelease?.let { StableRef.create(it) }
+    val arrayBuffer = JS_NewArrayBuffer(
+      context,
+      data.reinterpret(),
+      size.convert(),
+      staticCFunction(::jsFreeArrayBufferGlobal),
+      onReleaseRef?.asCPointer(),
+      0,
+    )
+    if (JS_IsException(arrayBuffer) != 0) {
+      // QuickJS doesn't call the free function if it fails to create the ArrayBuffer.
+      onReleaseRef?.dispose()
+      throwJsException()
+    }
+
+    val globalThis = JS_GetGlobalObject(context)
+    try {
+      if (JS_SetPropertyStr(context, globalThis, name, arrayBuffer) < 0) {
+        throwJsException()
+      }
+    } finally {
+      JS_FreeValue(context, globalThis)
+    }
+  }
+
+  /**
+   * Returns the memory of the global JavaScript `ArrayBuffer` [name], or null if that global isn't
+   * an `ArrayBuffer`.
+   *
+   * The `ArrayBuffer` is retained, even if JavaScript replaces or deletes the global, until the
+   * returned memory is passed to [releaseArrayBuffer] or this instance is closed. Don't use the
+   * returned memory after that.
+   */
+  fun getArrayBuffer(name: String): ArrayBufferMemory? {
+    checkNotClosed()
+
+    val globalThis = JS_GetGlobalObject(context)
+    val arrayBuffer = JS_GetPropertyStr(context, globalThis, name)
+    JS_FreeValue(context, globalThis)
+    if (JS_IsException(arrayBuffer) != 0) {
+      throwJsException()
+    }
+
+    memScoped {
+      val sizeVar = alloc<size_tVar>()
+      val data = JS_GetArrayBuffer(context, sizeVar.ptr, arrayBuffer)
+      if (data == null) {
+        // Not an ArrayBuffer, or a detached one.
+        JS_FreeValue(context, JS_GetException(context))
+        JS_FreeValue(context, arrayBuffer)
+        return null
+      }
+
+      // Keep the memory alive until releaseArrayBuffer() is called with the returned memory. Each
+      // ArrayBuffer is retained once, and counts how many returned memories share it.
+      val key = data.reinterpret<ByteVar>()
+      val retained = retainedArrayBuffers[key]
+      if (retained != null) {
+        retained.count++
+        JS_FreeValue(context, arrayBuffer)
+      } else {
+        retainedArrayBuffers[key] = RetainedArrayBuffer(arrayBuffer)
+      }
+      return ArrayBufferMemory(key, sizeVar.value.convert())
+    }
+  }
+
+  /**
+   * Releases the `ArrayBuffer` retained for [memory], which must have been returned by
+   * [getArrayBuffer] and not released yet. Don't use [memory] after calling this.
+   */
+  fun releaseArrayBuffer(memory: ArrayBufferMemory) {
+    checkNotClosed()
+
+    val retained = retainedArrayBuffers[memory.data]
+    require(retained != null) {
+      "memory wasn't returned by getArrayBuffer() or was already released"
+    }
+    if (--retained.count == 0) {
+      JS_FreeValue(context, retained.arrayBuffer)
+      retainedArrayBuffers.remove(memory.data)
+    }
+  }
+
   actual fun compile(sourceCode: String, fileName: String): ByteArray {
     checkNotClosed()
 
@@ -322,6 +549,27 @@ actual class QuickJs private constructor(
     return result
   }
 
+  /**
+   * Runs pending jobs, like promise reactions, until none remain, [maxJobs] jobs have run, or
+   * [budgetNanos] have elapsed. A limit of 0 or less means no limit. This is much cheaper than
+   * running jobs one call at a time.
+   *
+   * Returns true if jobs remain pending.
+   *
+   * @throws QuickJsException if a job throws.
+   */
+  actual fun executePendingJobs(maxJobs: Int, budgetNanos: Long): Boolean {
+    checkNotClosed()
+
+    memScoped {
+      val jobContext = alloc<CPointerVar<JSContext>>()
+      if (JS_ExecutePendingJobs(runtime, maxJobs, budgetNanos, jobContext.ptr) < 0) {
+        throwJsException()
+      }
+    }
+    return JS_IsJobPending(runtime) != 0
+  }
+
   internal actual fun initOutboundChannel(outboundChannel: CallChannel) {
     checkNotClosed()
 
@@ -367,7 +615,7 @@ actual class QuickJs private constructor(
     assert(argc == 1)
     val arg0 = JsValueArrayToInstanceRef(argv, 0).toKotlinInstanceOrNull() as String
     val result = outboundChannel!!.call(arg0)
-    return JS_NewString(context, result.utf8)
+    return result.toJsString()
   }
 
   internal fun jsOutboundDisconnect(argc: Int, argv: CArrayPointer<JSValue>): CValue<JSValue> {
@@ -377,6 +625,49 @@ actual class QuickJs private constructor(
     return result.toJsValue()
   }
 
+  internal actual fun initTimers(timerScheduler: TimerScheduler) {
+    checkNotClosed()
+    check(this.timerScheduler == null) { "timers already initialized" }
+
+    this.timerScheduler = timerScheduler
+    val timers = installTimers(
+      context,
+      staticCFunction(::jsScheduleTimersGlobal),
+      thisPtr.asCPointer(),
+    )
+    if (JS_IsException(timers) != 0) {
+      throwJsException()
+    }
+    this.timers = timers
+  }
+
+  /** Returns < 0 and throws a JavaScript exception if the timers couldn't be scheduled. */
+  internal fun jsScheduleTimers(bucketId: Int, delayMillis: Int): Int {
+    try {
+      timerScheduler?.scheduleTimers(bucketId, delayMillis)
+      return 0
+    } catch (t: Throwable) {
+      val error = JS_NewError(context)
+      JS_SetPropertyStr(context, error, "message", JS_NewString(context, t.toString()))
+      JS_Throw(context, error)
+      return -1
+    }
+  }
+
+  internal actual fun startTimers(bucketId: Int) {
+    checkNotClosed()
+
+    app.cash.zipline.quickjs.startTimers(context, timers!!, bucketId)
+  }
+
+  internal actual fun runTimers(bucketId: Int) {
+    checkNotClosed()
+
+    if (app.cash.zipline.quickjs.runTimers(context, timers!!, bucketId) < 0) {
+      throwJsException()
+    }
+  }
+
   internal actual fun getInboundChannel(): CallChannel {
     checkNotClosed()
 
@@ -394,8 +685,31 @@ actual class QuickJs private constructor(
     JS_RunGC(runtime)
   }
 
+  /**
+   * Performs pending garbage collection work if it is expected to fit within [budgetNanos]. Use
+   * this with [incrementalGc] to collect garbage from an idle handler.
+   *
+   * A full collection can't be split across calls. It runs to completion if the previous one took
+   * no longer than [budgetNanos], and is skipped otherwise. The budget only decides whether to
+   * start; it doesn't bound how long this call takes.
+   *
+   * Returns true if work remains pending.
+   */
+  actual fun gcStep(budgetNanos: Long): Boolean {
+    checkNotClosed()
+
+    return JS_RunGCStep(runtime, budgetNanos) != 0
+  }
+
   actual override fun close() {
     if (!closed) {
+      for (retained in retainedArrayBuffers.values) {
+        JS_FreeValue(context, retained.arrayBuffer)
+      }
+      retainedArrayBuffers.clear()
+      timers?.let { JS_FreeValue(context, it) }
+      timers = null
+      timerScheduler = null
       JS_FreeContext(contextForCompiling)
       JS_FreeContext(context)
       JS_FreeRuntime(runtime)
@@ -458,6 +772,12 @@ actual class QuickJs private constructor(
   private fun Boolean.toJsValue(): CValue<JSValue> {
     return if (this) JsTrue() else JsFalse()
   }
+
+  internal fun String.toJsString(): CValue<JSValue> {
+    val stringUtf8 = utf8
+    // Drop trailing '\0':
+    return JS_NewStringInterned(context, stringUtf8, (stringUtf8.size - 1).convert())
+  }
 }
 
 internal fun jsInterruptHandlerGlobal(runtime: CPointer<JSRuntime>?, opaque: COpaquePointer?): Int {
@@ -465,6 +785,32 @@ internal fun jsInterruptHandlerGlobal(runtime: CPointer<JSRuntime>?, opaque: COp
   return quickJs.jsInterruptHandler(runtime)
 }
 
+internal fun jsGcCallbackGlobal(runtime: CPointer<JSRuntime>?, opaque: COpaquePointer?) {
+  val quickJs = opaque!!.asStableRef<QuickJs>().get()
+  quickJs.jsGcCallback(runtime)
+}
+
+internal fun jsScheduleTimersGlobal(opaque: COpaquePointer?, bucketId: Int, delayMillis: Int): Int {
+  val quickJs = opaque!!.asStableRef<QuickJs>().get()
+  return quickJs.jsScheduleTimers(bucketId, delayMillis)
+}
+
+@Suppress("UNUSED_PARAMETER") // API shape mandated by QuickJs.
+internal fun jsFreeArrayBufferGlobal(
+  runtime: CPointer<JSRuntime>?,
+  opaque: COpaquePointer?,
+  ptr: COpaquePointer?,
+) {
+  val onReleaseRef = opaque?.asStableRef<() -> Unit>() ?: return
+  try {
+    onReleaseRef.get().invoke()
+  } catch (t: Throwable) {
+    // The ArrayBuffer may be freed by the collector or by close(), so there's no call to fail.
+  } finally {
+    onReleaseRef.dispose()
+  }
+}
+
 @Suppress("UNUSED_PARAMETER") // API shape mandated by QuickJs.
 internal fun outboundCall(
   context: CPointer<JSContext>,